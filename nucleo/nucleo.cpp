@@ -2,7 +2,7 @@
 //  NUCLEO PART OF THE APPLICATION
 ///////////////////////////////////////////////////////////////////////////////
 #define VERSION_MAJOR 1
-#define VERSION_MINOR 1
+#define VERSION_MINOR 2
 #define VERSION_PATCH 0
 
 #include "mbed.h"
@@ -21,19 +21,19 @@ Serial serial(SERIAL_TX, SERIAL_RX);
 /* STRUCT WITH LOCAL VARIABLES */
 static struct
 {
-    double cx;        // real constant part
-    double cy;        // imaginary constant part
-    double dx;        // shift in real axes
-    double dy;        // shift in imaginary axes
-    double sx;        // start of the x-coords (real)
-    double sy;        // start of the y-coords (imaginary)
-    double px;        // actual position of the x-coords (real)
-    double py;        // actual position of the y-coords (imaginary)
-    int task_id;      // index of current task, checks if we are done
-    uint8_t nx;       // number of cells in x-coords
-    uint8_t ny;       // number of cells in y-coords
-    uint8_t cid;      // chunk id
-    uint8_t max_iter; // maximum number of iterations
+    double cx;         // real constant part
+    double cy;         // imaginary constant part
+    double dx;         // shift in real axes
+    double dy;         // shift in imaginary axes
+    double sx;         // start of the x-coords (real)
+    double sy;         // start of the y-coords (imaginary)
+    double px;         // actual position of the x-coords (real)
+    double py;         // actual position of the y-coords (imaginary)
+    int task_id;       // index of current task, checks if we are done
+    uint8_t nx;        // number of cells in x-coords
+    uint8_t ny;        // number of cells in y-coords
+    uint8_t cid;       // chunk id
+    uint32_t max_iter; // maximum number of iterations
     int msg_len;
     float period;
     bool computing;
@@ -77,7 +77,7 @@ msg_version VERSION = {.major = VERSION_MAJOR,
  * MSG_GET_VERSION      -> MSG_VERSION
  * MSG_SET_COMPUTE      -> MSG_ERROR / MSG_OK
  * MSG_COMPUTE          -> MSG_ERROR / MSG_OK + MSG_COMPUTE_DATA / MSG_DONE
- * COMPUTING            -> BLINK WITH LED + MSG_COMPUTE_DATA
+ * COMPUTING            -> BLINK WITH LED + MSG_COMPUTE_DATA(_WIDE)
  * COMPUTATION DONE     -> MSG_DONE
  * MSG_ABORT            -> MSG_OK
  * COMPUTATION ABORTED  -> MSG_ABORT
@@ -206,7 +206,8 @@ int main(void)
                 compute_iter(&msg);
                 nucleo.task_id++;
                 move_cursor(&msg);
-                msg.type = MSG_COMPUTE_DATA;
+                msg.type = nucleo.max_iter < UINT8_MAX ? MSG_COMPUTE_DATA
+                                                       : MSG_COMPUTE_DATA_WIDE;
                 fill_message_buf(&msg, msg_buf, MESSAGE_SIZE,
                                  &nucleo.msg_len);
                 send_buffer(msg_buf, nucleo.msg_len);
@@ -371,7 +372,7 @@ void save_values(message *msg)
 /* RETURN THE POSSITIONS AND RIGHT ITERATION NUMBER */
 void compute_iter(message *msg)
 {
-    uint8_t ret = 0;
+    uint32_t ret = 0;
     while (ret <= nucleo.max_iter &&
            (nucleo.px * nucleo.px + nucleo.py * nucleo.py) < 4)
     {
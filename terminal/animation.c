@@ -0,0 +1,216 @@
+///////////////////////////////////////////////////////////////////////////////
+//  ANIMATION FRAMES RENDERED IN PARALLEL AND SHOWN IN ORDER
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The producer thread hands the frames to the pool, each frame is one task
+ * and only the frames which have a free slot in the ring are handed over, so
+ * no worker ever waits for the ring. The finished frames wait in the ring
+ * until the presenter thread shows them in their order at the target rate.
+ * The boss thread only starts, cancels and finishes the animation, so it
+ * keeps handling the other events.
+ */
+
+#include "animation.h"
+#include "computation.h"
+#include "my_functions.h"
+#include "thread_pool.h"
+#include <pthread.h>
+#include <time.h>
+
+#define ANIM_SLOTS 8 // frames rendered ahead of the shown one
+
+/* ONE RENDERED FRAME WAITING FOR THE PRESENTER */
+typedef struct
+{
+	unsigned char *img;
+	int frame; // number of the frame in the slot, -1 if it is free
+} anim_slot;
+
+/* STRUCT HOLDING THE ANIMATION, THE FIELDS BELOW THE MUTEX ARE SHARED */
+static struct
+{
+	int frames;
+	double fps;
+	int w;
+	int h;
+	void (*show)(unsigned char *img);
+	void (*done)(int run);
+	pthread_t producer;
+	pthread_t presenter;
+	bool running; // boss thread only, between start and finish
+	int run;	  // boss thread only, number of the last started animation
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	anim_slot slots[ANIM_SLOTS];
+	int shown; // the next frame the presenter shows
+	bool cancel;
+} anim = {.running = false,
+		  .run = 0,
+		  .mtx = PTHREAD_MUTEX_INITIALIZER,
+		  .cond = PTHREAD_COND_INITIALIZER};
+
+/* RENDER THE FRAME FIRST + TASK INTO ITS SLOT, WHICH IS FREE */
+static void frame_task(int task, void *arg)
+{
+	const int frame = *(const int *)arg + task;
+	anim_slot *slot = &anim.slots[frame % ANIM_SLOTS];
+	pthread_mutex_lock(&anim.mtx);
+	const bool cancel = anim.cancel;
+	pthread_mutex_unlock(&anim.mtx);
+	if (cancel) // the rest of the batch is dropped quickly
+	{
+		return;
+	}
+	render_frame(frame, anim.frames, anim.w, anim.h, slot->img);
+	pthread_mutex_lock(&anim.mtx);
+	slot->frame = frame;
+	pthread_cond_broadcast(&anim.cond);
+	pthread_mutex_unlock(&anim.mtx);
+}
+
+/* HAND THE FRAMES WITH A FREE SLOT TO THE POOL UNTIL THERE IS NONE LEFT */
+static void *producer_thread(void *arg)
+{
+	(void)arg;
+	int first = 0; // the first frame not handed over yet
+	pthread_mutex_lock(&anim.mtx);
+	while (true)
+	{
+		while (!anim.cancel && first - anim.shown >= ANIM_SLOTS) // ring full
+		{
+			pthread_cond_wait(&anim.cond, &anim.mtx);
+		}
+		if (anim.cancel || first >= anim.frames)
+		{
+			break;
+		}
+		const int count = MIN(anim.shown + ANIM_SLOTS, anim.frames) - first;
+		pthread_mutex_unlock(&anim.mtx);
+		pool_run(count, frame_task, &first); // the workers are free in between
+		first += count;
+		pthread_mutex_lock(&anim.mtx);
+	}
+	pthread_mutex_unlock(&anim.mtx);
+	return NULL;
+}
+
+/* SLEEP UNTIL THE TIME IN MILLISECONDS */
+static void sleep_until(double ms)
+{
+	const double left = ms - get_time_ms();
+	if (left > 0)
+	{
+		struct timespec ts = {.tv_sec = (time_t)(left / 1000),
+							  .tv_nsec = (long)(left * 1e6) % 1000000000L};
+		nanosleep(&ts, NULL);
+	}
+}
+
+/* SHOW THE FRAMES IN THEIR ORDER AT THE TARGET RATE */
+static void *presenter_thread(void *arg)
+{
+	(void)arg;
+	const double start = get_time_ms();
+	pthread_mutex_lock(&anim.mtx);
+	while (!anim.cancel && anim.shown < anim.frames)
+	{
+		anim_slot *slot = &anim.slots[anim.shown % ANIM_SLOTS];
+		while (!anim.cancel && slot->frame != anim.shown)
+		{
+			pthread_cond_wait(&anim.cond, &anim.mtx);
+		}
+		if (anim.cancel)
+		{
+			break;
+		}
+		pthread_mutex_unlock(&anim.mtx);
+		sleep_until(start + 1000 * anim.shown / anim.fps);
+		anim.show(slot->img);
+		pthread_mutex_lock(&anim.mtx);
+		slot->frame = -1;
+		anim.shown++;
+		pthread_cond_broadcast(&anim.cond); // a slot is free again
+	}
+	const bool cancel = anim.cancel;
+	pthread_mutex_unlock(&anim.mtx);
+	if (!cancel)
+	{
+		anim.done(anim.run);
+	}
+	return NULL;
+}
+
+/* START THE FRAMES, SHOW IS CALLED FOR EACH OF THEM, DONE AFTER THE LAST */
+bool anim_start(int frames, double fps, void (*show)(unsigned char *img),
+				void (*done)(int run))
+{
+	if (anim.running || frames <= 0)
+	{
+		return false;
+	}
+	get_grid_size(&anim.w, &anim.h);
+	anim.frames = frames;
+	anim.fps = fps;
+	anim.show = show;
+	anim.done = done;
+	anim.run++;
+	anim.shown = 0;
+	anim.cancel = false;
+	prepare_frames();
+	for (int i = 0; i < ANIM_SLOTS; i++)
+	{
+		anim.slots[i].img = my_alloc(3 * anim.w * anim.h);
+		anim.slots[i].frame = -1;
+	}
+	if (pthread_create(&anim.producer, NULL, producer_thread, NULL) ||
+		pthread_create(&anim.presenter, NULL, presenter_thread, NULL))
+	{
+		ERROR("Could not start the animation threads.\n");
+		exit(100);
+	}
+	anim.running = true;
+	return true;
+}
+
+/* RETURN TRUE BETWEEN THE START AND THE FINISH OF THE ANIMATION */
+bool anim_running(void)
+{
+	return anim.running;
+}
+
+/* RETURN THE NUMBER OF THE LAST STARTED ANIMATION, DONE IS CALLED WITH IT */
+int anim_run(void)
+{
+	return anim.run;
+}
+
+/* RETURN THE NUMBER OF THE FRAMES SHOWN SO FAR */
+int anim_shown(void)
+{
+	pthread_mutex_lock(&anim.mtx);
+	const int shown = anim.shown;
+	pthread_mutex_unlock(&anim.mtx);
+	return shown;
+}
+
+/* JOIN THE THREADS AND FREE THE FRAMES, THE WORKERS END THEIR FRAME FIRST */
+void anim_finish(bool cancel)
+{
+	if (!anim.running)
+	{
+		return;
+	}
+	pthread_mutex_lock(&anim.mtx);
+	anim.cancel = anim.cancel || cancel;
+	pthread_cond_broadcast(&anim.cond);
+	pthread_mutex_unlock(&anim.mtx);
+	pthread_join(anim.presenter, NULL);
+	pthread_join(anim.producer, NULL);
+	for (int i = 0; i < ANIM_SLOTS; i++)
+	{
+		free(anim.slots[i].img);
+		anim.slots[i].img = NULL;
+	}
+	anim.running = false;
+}
@@ -0,0 +1,17 @@
+///////////////////////////////////////////////////////////////////////////////
+//  ANIMATION FRAMES RENDERED IN PARALLEL AND SHOWN IN ORDER
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ANIMATION_H__
+#define __ANIMATION_H__
+
+#include <stdbool.h>
+
+bool anim_start(int frames, double fps, void (*show)(unsigned char *img),
+				void (*done)(int run));
+bool anim_running(void);
+int anim_run(void);
+int anim_shown(void);
+void anim_finish(bool cancel);
+
+#endif
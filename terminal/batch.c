@@ -0,0 +1,271 @@
+///////////////////////////////////////////////////////////////////////////////
+//  HEADLESS BATCH RENDERING OF A JOB FILE
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * One job per line of key=value words, the missing keys keep the values of
+ * the previous job, the first one starts from the defaults:
+ *
+ *    c=-0.4,0.6 re=-1.6,1.6 im=-1.1,1.1 n=60 size=640x480 out=julia.ppm
+ *
+ * A line "settings vd" toggles the settings like the keys of the startup
+ * screen. The image is written as ppm or bmp, the frames of the jobs naming
+ * the same .y4m or .rgb file one after another go to that video. Neither
+ * the serial device nor SDL is touched.
+ */
+
+#include "batch.h"
+#include "computation.h"
+#include "kernel.h"
+#include "my_functions.h"
+#include "thread_pool.h"
+#include "tile_cache.h"
+#include "video.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BATCH_LINE 1024	 // longest line of the job file
+#define BATCH_FPS 30	 // frame rate written to the y4m header
+
+/* VIDEO THE FRAMES OF THE JOBS GO TO */
+static struct
+{
+	char path[BATCH_LINE]; // empty if no video is open
+	int w;
+	int h;
+} batch = {.path = ""};
+
+/* RETURN TRUE IF THE PATH ENDS WITH THE SUFFIX */
+static bool ends_with(const char *path, const char *suffix)
+{
+	const size_t len = strlen(path);
+	const size_t n = strlen(suffix);
+	return len >= n && !strcmp(path + len - n, suffix);
+}
+
+/* WRITE THE RGB IMAGE AS BINARY PPM */
+static bool write_ppm(const char *path, int w, int h, const unsigned char *img)
+{
+	FILE *f = fopen(path, "wb");
+	if (!f)
+	{
+		return false;
+	}
+	const bool ok = fprintf(f, "P6\n%d %d\n255\n", w, h) > 0 &&
+					fwrite(img, 3 * w * h, 1, f) == 1;
+	return !fclose(f) && ok;
+}
+
+/* STORE THE VALUE IN LITTLE ENDIAN */
+static void put_le(unsigned char *p, uint32_t value, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+	{
+		p[i] = value >> (8 * i);
+	}
+}
+
+/* WRITE THE RGB IMAGE AS 24 BIT BMP, BOTTOM UP IN BGR */
+static bool write_bmp(const char *path, int w, int h, const unsigned char *img)
+{
+	FILE *f = fopen(path, "wb");
+	if (!f)
+	{
+		return false;
+	}
+	const int stride = (3 * w + 3) & ~3; // rows are padded to 4 bytes
+	unsigned char header[54] = {'B', 'M'};
+	put_le(header + 2, 54 + stride * h, 4); // file size
+	put_le(header + 10, 54, 4);				// offset of the pixels
+	put_le(header + 14, 40, 4);				// size of the info header
+	put_le(header + 18, w, 4);
+	put_le(header + 22, h, 4);
+	put_le(header + 26, 1, 2);	// planes
+	put_le(header + 28, 24, 2); // bits per pixel
+	put_le(header + 34, stride * h, 4);
+	unsigned char *row = my_alloc(stride);
+	memset(row, 0, stride);
+	bool ok = fwrite(header, sizeof(header), 1, f) == 1;
+	for (int y = h - 1; y >= 0 && ok; y--)
+	{
+		const unsigned char *src = img + 3 * w * y;
+		for (int x = 0; x < w; x++)
+		{
+			row[3 * x] = src[3 * x + 2];
+			row[3 * x + 1] = src[3 * x + 1];
+			row[3 * x + 2] = src[3 * x];
+		}
+		ok = fwrite(row, stride, 1, f) == 1;
+	}
+	free(row);
+	return !fclose(f) && ok;
+}
+
+/* READ THE KEY=VALUE WORDS OF THE LINE INTO THE VIEW, FALSE ON AN ERROR */
+static bool parse_job(char *line, view_params *v, char *out, size_t out_len)
+{
+	for (char *word = strtok(line, " \t\r\n"); word;
+		 word = strtok(NULL, " \t\r\n"))
+	{
+		char *value = strchr(word, '=');
+		if (!value)
+		{
+			return false;
+		}
+		*value++ = '\0';
+		char rest;
+		bool ok;
+		if (!strcmp(word, "c"))
+		{
+			ok = sscanf(value, "%lf,%lf%c", &v->c_re, &v->c_im, &rest) == 2;
+		}
+		else if (!strcmp(word, "re"))
+		{
+			ok = sscanf(value, "%lf,%lf%c", &v->re_min, &v->re_max, &rest) ==
+					 2 &&
+				 v->re_min < v->re_max;
+		}
+		else if (!strcmp(word, "im"))
+		{
+			ok = sscanf(value, "%lf,%lf%c", &v->im_min, &v->im_max, &rest) ==
+					 2 &&
+				 v->im_min < v->im_max;
+		}
+		else if (!strcmp(word, "n"))
+		{
+			ok = sscanf(value, "%d%c", &v->n, &rest) == 1 && v->n > 0;
+		}
+		else if (!strcmp(word, "size"))
+		{
+			ok = sscanf(value, "%dx%d%c", &v->w, &v->h, &rest) == 2 &&
+				 v->w > 0 && v->h > 0;
+		}
+		else if (!strcmp(word, "out"))
+		{
+			ok = strlen(value) < out_len;
+			if (ok)
+			{
+				strcpy(out, value);
+			}
+		}
+		else
+		{
+			ok = false;
+		}
+		if (!ok)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/* WRITE THE IMAGE OF THE JOB, THE VIDEO IS OPENED WHEN THE NAME CHANGES */
+static bool write_output(const char *out, int w, int h,
+						 const unsigned char *img)
+{
+	if (ends_with(out, ".y4m") || ends_with(out, ".rgb"))
+	{
+		if (strcmp(out, batch.path))
+		{
+			video_close();
+			batch.path[0] = '\0';
+			if (!video_open(out, w, h, BATCH_FPS))
+			{
+				return false;
+			}
+			strcpy(batch.path, out);
+			batch.w = w;
+			batch.h = h;
+		}
+		if (w != batch.w || h != batch.h) // the frames of a video are alike
+		{
+			return false;
+		}
+		video_frame(img);
+		return true;
+	}
+	return ends_with(out, ".bmp") ? write_bmp(out, w, h, img)
+								  : write_ppm(out, w, h, img);
+}
+
+/* RENDER ALL JOBS OF THE FILE, RETURN FALSE IF SOME OF THEM FAILED */
+bool batch_run(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		ERROR("The job file can not be opened\n");
+		return false;
+	}
+	char line[BATCH_LINE];
+	char out[BATCH_LINE] = "fractal.ppm";
+	view_params v;
+	get_view(&v);
+	unsigned char *img = NULL;
+	int nbr_line = 0;
+	int jobs = 0;
+	int failed = 0;
+	const double start = get_time_ms();
+	kernel_init();
+	pool_init(sysconf(_SC_NPROCESSORS_ONLN)); // kept over all jobs
+	while (fgets(line, sizeof(line), f))
+	{
+		nbr_line++;
+		const char *first = line + strspn(line, " \t\r\n");
+		if (!*first || *first == '#')
+		{
+			continue;
+		}
+		if (!strncmp(first, "settings", 8))
+		{
+			for (const char *k = first + 8; *k; k++)
+			{
+				if (*k != 'q' && *k != ' ' && *k != '\t' && *k != '\n')
+				{
+					change_settings(*k);
+				}
+			}
+			computation_cleanup(); // the buffers follow the new settings
+			continue;
+		}
+		if (!parse_job(line, &v, out, sizeof(out)))
+		{
+			WARN("Wrong job skipped on line ");
+			fprintf(stderr, "%d of %s\n", nbr_line, path);
+			failed++;
+			get_view(&v); // the next job starts from the last good one
+			continue;
+		}
+		const double job_start = get_time_ms();
+		set_view(&v);
+		compute_cpu(NULL);
+		const double job_end = get_time_ms();
+		free(img);
+		img = my_alloc(3 * v.w * v.h);
+		update_image(v.w, v.h, img);
+		const bool written = write_output(out, v.w, v.h, img);
+		failed += !written;
+		jobs++;
+		printf("job %d: %dx%d n=%d %s precision, %.1f ms on %d threads, "
+			   "%.1f ms written -> %s%s\n",
+			   jobs, v.w, v.h, v.n, precision_name(), job_end - job_start,
+			   pool_threads(), get_time_ms() - job_end, out,
+			   written ? "" : " FAILED");
+	}
+	fclose(f);
+	if (batch.path[0])
+	{
+		printf("video %s has %d frames\n", batch.path, video_close());
+		batch.path[0] = '\0';
+	}
+	free(img);
+	printf("%d jobs in %.1f ms, %d failed\n", jobs, get_time_ms() - start,
+		   failed);
+	computation_cleanup();
+	pool_cleanup();
+	cache_cleanup(); // kept over all jobs, whatever their size
+	return failed == 0;
+}
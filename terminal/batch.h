@@ -0,0 +1,12 @@
+///////////////////////////////////////////////////////////////////////////////
+//  HEADLESS BATCH RENDERING OF A JOB FILE
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <stdbool.h>
+
+bool batch_run(const char *path);
+
+#endif
@@ -3,15 +3,98 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "computation.h"
+#include "kernel.h"
 #include "message.h"
 #include "my_functions.h"
+#include "palette.h"
+#include "perturbation.h"
+#include "thread_pool.h"
+#include "tile_cache.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <unistd.h>
-#define MAX(a, b) (((a) > (b)) ? (a) : (b))
-#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define TILE_SIZE 64 // edge of the square block rendered by one worker task
+#define MIN_SUBDIVISION 6 // smaller rectangles are computed pixel by pixel
+#define SYMMETRY_EPS 1e-6 // distance from a whole pixel still mirrored
+#define FLOAT_LIMIT 1e-4 // relative pixel size still rendered in float
+#define DEEP_ZOOM_LIMIT 1e-12 // relative pixel size rendered by perturbation
+#define ZOOM_LIMIT 1e-30	  // relative pixel size the double-double can hold
+#define MAX_ITERATION 0xffffff // interior value n + 1 is still exact in float
+#define DE_RADIUS 1e6	  // squared |z| iterated to after escape for the estimate
+#define DE_SUPERSAMPLE 4  // samples per axis of the pixels on the boundary
+#define PROGRESSIVE_STEP 4 // block edge of the first coarse pass
+#define PAN_EPS 1e-6	   // distance from a whole pixel still reused on pan
+#define CACHE_MB 64		   // default budget of the tile cache in megabytes
+#define ANIMATION_STEP 0.005 // change of the constant between two frames
+#define IMAGE_BAND 65536	 // pixels colored by one worker task, whole rows
+
+/* HOW THE PRECISION OF THE CPU COMPUTATION IS CHOSEN */
+enum
+{
+	LADDER_AUTO,   // float, double or perturbation by the pixel size, the
+				   // float pixels may escape a few iterations off the double
+	LADDER_MIXED,  // the same, float pixels on band edges redone in double,
+				   // the pixels inside the bands stay approximate
+	LADDER_DOUBLE, // float is never used, the default bit-exact image
+	LADDER_NBR
+};
+
+/* PRECISION OF THE CPU COMPUTATION, FROM THE CHEAPEST */
+enum
+{
+	PRECISION_FLOAT,
+	PRECISION_DOUBLE,
+	PRECISION_DD // double-double reference orbit, pixels by perturbation
+};
+
+static const char *ladder_names[] = {"auto", "mixed", "double"};
+static const char *precision_names[] = {"float", "double",
+										"double-double perturbation"};
+static const char *formula_names[] = {"julia", "mandelbrot", "burning ship"};
+static const int cache_budgets[] = {0, 16, 64, 256}; // megabytes, 0 is off
+#define CACHE_BUDGETS (int)(sizeof(cache_budgets) / sizeof(cache_budgets[0]))
+
+/* PARAMETERS OF THE VIEW THE GRID WAS RENDERED WITH */
+typedef struct
+{
+	double c_re;
+	double c_im;
+	int n;
+	double d_re;
+	double d_im;
+	dd center_re;
+	dd center_im;
+	int precision; // the reused pixels must not be less precise
+	int formula;
+	int power;
+} view_state;
+
+/* EVERYTHING THE PIXELS OF ONE CACHED TILE OR CHUNK DEPEND ON */
+typedef struct
+{
+	double c_re;
+	double c_im;
+	double d_re;
+	double d_im;
+	double re_min; // the chunks and the cpu below perturbation start here
+	double im_max;
+	dd center_re;
+	dd center_im;
+	int n;
+	int grid_w;
+	int grid_h;
+	int precision; // -1 for the chunks computed by nucleo
+	int ladder;
+	int formula;
+	int power;
+	int flags; // periodicity, subdivision, smoothing and distance estimation
+	int x;
+	int y;
+	int w;
+	int h;
+} tile_key;
 
 /* STRUCT HOLDING ALL VARIABLES NEEDED HERE */
 static struct
@@ -19,6 +102,8 @@ static struct
 	double c_re;			   // constants in real axis
 	double c_im;			   // constants in imaginary axis
 	int n;					   // number of iterations
+	int formula;			   // FORMULA_JULIA, FORMULA_MANDELBROT...
+	int power;				   // d of z^d + c
 	double range_re_min;	   // picture min_range in x-coords
 	double range_re_max;	   // picture max_range in x-coords
 	double range_im_min;	   // picture min_range in y-coords
@@ -35,8 +120,61 @@ static struct
 	double chunk_im;		   // chunk left top corner
 	uint8_t chunk_n_re;		   // number of pixels in chunk in real axes
 	uint8_t chunk_n_im;		   // number of pixels in chunk in imagianry axes
-	uint8_t *grid;			   // grid array containing number of iterrations
-	uint8_t *grid_computation; // necessary for 'p', stores only current comp.
+	void *grid;				   // grid array containing number of iterrations
+	void *grid_computation;	   // necessary for 'p', stores only current comp.
+	int cell;				   // bytes per pixel of both grids, n + 1 fits
+	bool smoothing;			   // compute the continuous escape values
+	float *smooth;			   // continuous escape value of every pixel
+	bool smooth_ready;		   // smooth belongs to the shown grid
+	bool distance;			   // supersample the boundary by distance estimate
+	uint8_t *samples;		   // samples averaged in every pixel, 0 if one
+	unsigned char *rgb;		   // averaged color of the supersampled pixels
+	uint32_t *colors;		   // palette table of table_n, NULL if too large
+	int table_n;			   // n the table was made for, -1 if none
+	uint32_t *pixel_colors;	   // table of pixel_n in the pixels of the window
+	int pixel_n;			   // n of the pixel table, -1 if none
+	pixel_format format;	   // channels of the pixel table
+	grid_rect damage[DAMAGE_RECTS]; // changed since the last refresh
+	int damaged;			   // rectangles in damage
+	bool damage_all;		   // the whole grid changed
+	bool antialiased;		   // samples and rgb belong to the shown grid
+	int supersampled;		   // pixels supersampled in the last cpu run
+	bool progressive;		   // show coarse passes before the full resolution
+	bool deepening;			   // keep the orbits to continue with a higher n
+	double *orbit_re;		   // last orbit point of every pixel, NaN if none
+	double *orbit_im;
+	bool orbits_ready;		   // the orbits belong to the shown grid
+	int resumed;			   // pixels continued from their orbits last run
+	int escaped;			   // of them escaped with the higher n
+	int resumed_from;		   // the n they were continued from
+	double *coord_re;		   // real coordinate of every grid column
+	double *coord_im;		   // imaginary coordinate of every grid row
+	bool periodicity;		   // stop the orbits which fell into a cycle
+	int cycles;				   // pixels stopped by the periodicity check
+	bool subdivision;		   // fill the rectangles with uniform border
+	int computed;			   // pixels iterated in the last cpu computation
+	int mirrored;			   // pixels copied from their point reflection
+	dd center_re;			   // view centre, more precise than the ranges
+	dd center_im;			   // view centre in imaginary axis
+	view_state shown;		   // view of the grid, if shown_valid
+	bool shown_valid;		   // the grid holds a whole finished render
+	int reuse_x0;			   // [reuse_x0, reuse_x1) x [reuse_y0, reuse_y1)
+	int reuse_y0;			   // was moved from the shown grid by the pan
+	int reuse_x1;
+	int reuse_y1;
+	int reused;				   // pixels reused by the last computation
+	uint8_t *lattice;		   // pixels kept from the view before the zoom
+	int cache_mb;			   // budget of the tile cache, 0 if it is off
+	uint8_t *cached;		   // tiles of the cpu run taken from the cache
+	unsigned char *tile_buf;   // one tile or chunk packed for the cache
+	int cache_hits;			   // tiles or chunks taken from the cache
+	int cache_misses;		   // tiles or chunks computed and stored
+	int ladder;				   // how the precision is chosen
+	int precision;			   // precision of the last cpu computation
+	uint8_t *mask;			   // band edges found by the mixed pass
+	int refined;			   // pixels recomputed in double by the mixed pass
+	int reference;			   // length of its reference orbit
+	int rebased;			   // pixels rebased to the critical orbit
 	bool computing;			   // contains if we are computing or not
 	bool done;				   // true when the current computation is done
 	bool abort;				   // abort from keyboard or nucleo interrupt
@@ -44,6 +182,8 @@ static struct
 	{.c_re = -0.4,
 	 .c_im = 0.6,
 	 .n = 60,
+	 .formula = FORMULA_JULIA,
+	 .power = 2,
 	 .range_re_min = -1.6,
 	 .range_re_max = 1.6,
 	 .range_im_min = -1.1,
@@ -54,240 +194,2313 @@ static struct
 	 .chunk_n_im = 48,
 	 .grid = NULL,
 	 .grid_computation = NULL,
+	 .cell = 1,
+	 .smoothing = false,
+	 .smooth = NULL,
+	 .smooth_ready = false,
+	 .distance = false,
+	 .samples = NULL,
+	 .rgb = NULL,
+	 .colors = NULL,
+	 .table_n = -1,
+	 .pixel_n = -1,
+	 .damaged = 0,
+	 .damage_all = true,
+	 .antialiased = false,
+	 .supersampled = 0,
+	 .progressive = true,
+	 .deepening = false,
+	 .orbit_re = NULL,
+	 .orbit_im = NULL,
+	 .orbits_ready = false,
+	 .resumed = 0,
+	 .escaped = 0,
+	 .resumed_from = 0,
+	 .coord_re = NULL,
+	 .coord_im = NULL,
+	 .periodicity = false,
+	 .cycles = 0,
+	 .subdivision = false,
+	 .computed = 0,
+	 .mirrored = 0,
+	 .shown_valid = false,
+	 .reuse_x0 = 0,
+	 .reuse_y0 = 0,
+	 .reuse_x1 = 0,
+	 .reuse_y1 = 0,
+	 .reused = 0,
+	 .lattice = NULL,
+	 .cache_mb = CACHE_MB,
+	 .cached = NULL,
+	 .tile_buf = NULL,
+	 .cache_hits = 0,
+	 .cache_misses = 0,
+	 .ladder = LADDER_DOUBLE,
+	 .precision = PRECISION_DOUBLE,
+	 .mask = NULL,
+	 .refined = 0,
+	 .reference = 0,
+	 .rebased = 0,
 	 .computing = false,
 	 .done = false,
 	 .abort = false};
 
-/* INITIALIZE THE COMPUTATION */
-void computation_init(void)
+/* READ THE NUMBER OF ITERATIONS OF PIXEL I */
+static inline uint32_t cell_get(const void *grid, int cell, int i)
+{
+	return cell == 1   ? ((const uint8_t *)grid)[i]
+		   : cell == 2 ? ((const uint16_t *)grid)[i]
+					   : ((const uint32_t *)grid)[i];
+}
+
+/* STORE THE NUMBER OF ITERATIONS OF PIXEL I */
+static inline void cell_set(void *grid, int cell, int i, uint32_t value)
+{
+	if (cell == 1)
+	{
+		((uint8_t *)grid)[i] = value;
+	}
+	else if (cell == 2)
+	{
+		((uint16_t *)grid)[i] = value;
+	}
+	else
+	{
+		((uint32_t *)grid)[i] = value;
+	}
+}
+
+/* BYTES OF THE BUFFER HOLDING ONE PACKED TILE OR CHUNK */
+static size_t tile_buf_size(void)
+{
+	// a tile with all planes, the cell, 4 smooth, 1 samples and 3 rgb
+	return MAX(TILE_SIZE * TILE_SIZE * (comp.cell + 8),
+			   comp.chunk_n_re * comp.chunk_n_im * comp.cell);
+}
+
+/* NARROWEST CELL HOLDING THE INTERIOR VALUE N + 1 */
+static int cell_width(int n)
+{
+	return n < UINT8_MAX ? 1 : n < UINT16_MAX ? 2 : 4;
+}
+
+/* SET THE PIXEL SIZE, THE CENTRE AND THE CHUNKS BY THE RANGES */
+static void update_pixel_size(void)
+{
+	comp.d_re = (comp.range_re_max - comp.range_re_min) / (1. * comp.grid_w);
+	comp.d_im = -(comp.range_im_max - comp.range_im_min) / (1. * comp.grid_h);
+	comp.nbr_chunks = (comp.grid_w * comp.grid_h) /
+					  (comp.chunk_n_re * comp.chunk_n_im);
+	comp.center_re = dd_sum(comp.range_re_min, comp.range_re_max);
+	comp.center_im = dd_sum(comp.range_im_min, comp.range_im_max);
+	comp.center_re.hi /= 2; // exact, only the exponent changes
+	comp.center_re.lo /= 2;
+	comp.center_im.hi /= 2;
+	comp.center_im.lo /= 2;
+}
+
+/* THE WHOLE GRID IS SHOWN AGAIN ON THE NEXT REFRESH */
+static void damage_grid(void)
+{
+	comp.damage_all = true;
+	comp.damaged = 0;
+}
+
+/* RETURN TRUE IF THE RECTANGLES OVERLAP OR TOUCH */
+static bool rects_touch(const grid_rect *a, const grid_rect *b)
+{
+	return a->x <= b->x + b->w && b->x <= a->x + a->w &&
+		   a->y <= b->y + b->h && b->y <= a->y + a->h;
+}
+
+/* GROW THE RECTANGLE A TO THE BOUNDING BOX OF BOTH */
+static void rect_union(grid_rect *a, const grid_rect *b)
+{
+	const int x1 = MAX(a->x + a->w, b->x + b->w);
+	const int y1 = MAX(a->y + a->h, b->y + b->h);
+	a->x = MIN(a->x, b->x);
+	a->y = MIN(a->y, b->y);
+	a->w = x1 - a->x;
+	a->h = y1 - a->y;
+}
+
+/*
+ * Add the changed rectangle of the grid. The pixels of a chunk come row by
+ * row, so they touch the last rectangle and grow it, a rectangle which fits
+ * nowhere gets its own place. When all places are taken, they are merged.
+ */
+static void damage_rect(int x, int y, int w, int h)
+{
+	const grid_rect r = {.x = x, .y = y, .w = w, .h = h};
+	if (comp.damage_all)
+	{
+		return;
+	}
+	for (int i = comp.damaged - 1; i >= 0; i--)
+	{
+		if (rects_touch(&comp.damage[i], &r))
+		{
+			rect_union(&comp.damage[i], &r);
+			return;
+		}
+	}
+	if (comp.damaged == DAMAGE_RECTS)
+	{
+		for (int i = 1; i < comp.damaged; i++)
+		{
+			rect_union(&comp.damage[0], &comp.damage[i]);
+		}
+		comp.damaged = 1;
+		rect_union(&comp.damage[0], &r);
+		return;
+	}
+	comp.damage[comp.damaged++] = r;
+}
+
+/*
+ * Move the rectangles changed since the last call to rects, at most
+ * DAMAGE_RECTS of them, and return their number. The whole grid is one.
+ */
+int take_damage(grid_rect *rects)
+{
+	int count = comp.damaged;
+	if (comp.damage_all)
+	{
+		rects[0] = (grid_rect){.w = comp.grid_w, .h = comp.grid_h};
+		count = 1;
+	}
+	else
+	{
+		memcpy(rects, comp.damage, count * sizeof(grid_rect));
+	}
+	comp.damage_all = false;
+	comp.damaged = 0;
+	return count;
+}
+
+/* INITIALIZE THE COMPUTATION */
+void computation_init(void)
+{
+	// the interior pixels get n + 1, the narrowest cell holding it is used
+	comp.cell = cell_width(comp.n);
+	comp.grid = my_alloc(comp.cell * comp.grid_w * comp.grid_h);
+	comp.grid_computation = my_alloc(comp.cell * comp.grid_w * comp.grid_h);
+	if (comp.smoothing)
+	{
+		comp.smooth = my_alloc(comp.grid_w * comp.grid_h * sizeof(float));
+	}
+	if (comp.distance)
+	{
+		comp.samples = my_alloc(comp.grid_w * comp.grid_h);
+		comp.rgb = my_alloc(3 * comp.grid_w * comp.grid_h);
+	}
+	if (comp.deepening)
+	{
+		comp.orbit_re = my_alloc(comp.grid_w * comp.grid_h * sizeof(double));
+		comp.orbit_im = my_alloc(comp.grid_w * comp.grid_h * sizeof(double));
+	}
+	comp.coord_re = my_alloc(comp.grid_w * sizeof(double));
+	comp.coord_im = my_alloc(comp.grid_h * sizeof(double));
+	comp.mask = my_alloc(comp.grid_w * comp.grid_h);
+	comp.lattice = my_alloc(comp.grid_w * comp.grid_h);
+	comp.cached = my_alloc(((comp.grid_w + TILE_SIZE - 1) / TILE_SIZE) *
+						   ((comp.grid_h + TILE_SIZE - 1) / TILE_SIZE));
+	comp.tile_buf = my_alloc(tile_buf_size());
+	cache_budget((size_t)comp.cache_mb << 20); // the cache outlives the grids
+	update_pixel_size();
+	damage_grid();
+}
+
+/* CLEANUP ALL STORED DATA AFTER THE COMPUTATION */
+void computation_cleanup(void)
+{
+	if (comp.grid)
+	{
+		free(comp.grid);
+		free(comp.grid_computation);
+		free(comp.coord_re);
+		free(comp.coord_im);
+		free(comp.mask);
+		free(comp.lattice);
+		free(comp.cached);
+		free(comp.tile_buf);
+		free(comp.smooth);
+		free(comp.orbit_re);
+		free(comp.orbit_im);
+		free(comp.samples);
+		free(comp.rgb);
+		free(comp.colors);
+		free(comp.pixel_colors);
+		perturbation_cleanup();
+	}
+	comp.grid = NULL;
+	comp.smooth = NULL;
+	comp.orbit_re = NULL;
+	comp.orbit_im = NULL;
+	comp.samples = NULL;
+	comp.rgb = NULL;
+	comp.colors = NULL;
+	comp.table_n = -1;
+	comp.pixel_colors = NULL;
+	comp.pixel_n = -1;
+	comp.shown_valid = false; // the new buffers hold nothing of the last view
+	comp.smooth_ready = false;
+	comp.antialiased = false;
+	comp.orbits_ready = false;
+}
+
+/* FILL THE VIEW WITH THE CURRENT PARAMETERS */
+void get_view(view_params *v)
+{
+	v->c_re = comp.c_re;
+	v->c_im = comp.c_im;
+	v->re_min = comp.range_re_min;
+	v->re_max = comp.range_re_max;
+	v->im_min = comp.range_im_min;
+	v->im_max = comp.range_im_max;
+	v->n = comp.n;
+	v->w = comp.grid_w;
+	v->h = comp.grid_h;
+}
+
+/*
+ * Set the whole view at once, used without the startup screen. The buffers
+ * are allocated again only if the resolution, the cell or the settings which
+ * own a buffer changed, so the tile cache survives the jobs of one size.
+ */
+void set_view(const view_params *v)
+{
+	const bool realloc = !comp.grid || v->w != comp.grid_w ||
+						 v->h != comp.grid_h || cell_width(v->n) != comp.cell ||
+						 comp.smoothing != (comp.smooth != NULL) ||
+						 comp.distance != (comp.samples != NULL) ||
+						 comp.deepening != (comp.orbit_re != NULL);
+	if (realloc)
+	{
+		computation_cleanup();
+	}
+	comp.c_re = v->c_re;
+	comp.c_im = v->c_im;
+	comp.range_re_min = v->re_min;
+	comp.range_re_max = v->re_max;
+	comp.range_im_min = v->im_min;
+	comp.range_im_max = v->im_max;
+	comp.n = MIN(MAX(v->n, 1), MAX_ITERATION);
+	comp.grid_w = v->w;
+	comp.grid_h = v->h;
+	comp.chunk_n_re = MIN(comp.chunk_n_re, comp.grid_w); // one chunk at least
+	comp.chunk_n_im = MIN(comp.chunk_n_im, comp.grid_h);
+	if (realloc)
+	{
+		computation_init();
+		return;
+	}
+	update_pixel_size();
+	damage_grid();
+	comp.shown_valid = false; // nothing of the last view is kept
+	comp.orbits_ready = false;
+}
+
+/* RETURN TRUE IF COMPUTING */
+bool is_computing(void)
+{
+	return comp.computing;
+}
+
+/* RETURN TRUE IF COMPUTATION IS TOTALLY DONE */
+bool is_done(void)
+{
+	return comp.done;
+}
+
+/* CANCEL THE COMPUTATION ABORT */
+void enable_comp(void)
+{
+	comp.abort = false;
+}
+
+/* SET THE VALUES WE WANT TO COMPUTE */
+bool set_compute(message *msg)
+{
+	memset(comp.grid_computation, 0,
+		   comp.grid_w * comp.grid_h * comp.cell); // used for p cmd
+
+	bool ret = !is_computing();
+	if (ret)
+	{
+		msg->type = MSG_SET_COMPUTE;
+		msg->data.set_compute.c_re = comp.c_re;
+		msg->data.set_compute.c_im = comp.c_im;
+		msg->data.set_compute.d_re = comp.d_re;
+		msg->data.set_compute.d_im = comp.d_im;
+		msg->data.set_compute.n = comp.n;
+		comp.done = false;
+		damage_grid();
+	}
+	return ret;
+}
+
+/* POINT REFLECTION Z -> -Z OF THE VIEW, PIXEL (X, Y) MAPS TO (OX - X, OY - Y) */
+typedef struct
+{
+	int ox;
+	int oy;
+	int x0; // region which is mapped onto itself, inclusive
+	int y0;
+	int x1;
+	int y1;
+} symmetry;
+
+/*
+ * Find the part of the view overlapping its point reflection. Only the julia
+ * sets of the even powers have it, (-z)^d = z^d makes the orbits of z and -z
+ * meet after the first step.
+ */
+static bool find_symmetry(int offset, symmetry *sym)
+{
+	if (comp.formula != FORMULA_JULIA || comp.power % 2)
+	{
+		return false;
+	}
+	// pixel x lies at range_re_min + (x + offset) * d_re, the same for y
+	const double ox = -2 * comp.range_re_min / comp.d_re - 2 * offset;
+	const double oy = -2 * comp.range_im_max / comp.d_im - 2 * offset;
+	if (ox < 0 || oy < 0 || ox > 2 * comp.grid_w || oy > 2 * comp.grid_h ||
+		fabs(ox - round(ox)) > SYMMETRY_EPS ||
+		fabs(oy - round(oy)) > SYMMETRY_EPS)
+	{
+		return false;
+	}
+	sym->ox = lround(ox);
+	sym->oy = lround(oy);
+	sym->x0 = MAX(0, sym->ox - (comp.grid_w - 1));
+	sym->x1 = MIN(comp.grid_w - 1, sym->ox);
+	sym->y0 = MAX(0, sym->oy - (comp.grid_h - 1));
+	sym->y1 = MIN(comp.grid_h - 1, sym->oy);
+	return sym->x0 <= sym->x1 && sym->y0 <= sym->y1;
+}
+
+/* REMEMBER THE VIEW OF THE FINISHED GRID FOR THE NEXT PAN OR ZOOM */
+static void remember_view(int precision)
+{
+	comp.shown = (view_state){.c_re = comp.c_re,
+							  .c_im = comp.c_im,
+							  .n = comp.n,
+							  .d_re = comp.d_re,
+							  .d_im = comp.d_im,
+							  .center_re = comp.center_re,
+							  .center_im = comp.center_im,
+							  .precision = precision,
+							  .formula = comp.formula,
+							  .power = comp.power};
+	comp.shown_valid = true;
+}
+
+/* MOVE THE W x H PLANE OF SIZE BYTE ELEMENTS, PIXEL (X, Y) GETS (X+DX, Y+DY) */
+static void shift_plane(void *plane, int size, int dx, int dy)
+{
+	const int w = comp.grid_w;
+	const int x0 = MAX(0, -dx); // destination columns with a source
+	const int x1 = MIN(w, w - dx);
+	for (int i = 0; i < comp.grid_h; i++)
+	{
+		const int y = dy > 0 ? i : comp.grid_h - 1 - i; // sources not yet moved
+		if (y + dy < 0 || y + dy >= comp.grid_h)
+		{
+			continue;
+		}
+		char *row = (char *)plane + (size_t)y * w * size;
+		memmove(row + x0 * size, row + ((size_t)dy * w + x0 + dx) * size,
+				(x1 - x0) * size);
+	}
+}
+
+/* COPY ONE ELEMENT OF THE GRID, THE SMOOTH VALUES OR THE COLORS */
+static inline void copy_element(char *dst, const char *src, int size)
+{
+	switch (size)
+	{
+	case 1:
+		*dst = *src;
+		break;
+	case 2:
+		memcpy(dst, src, 2);
+		break;
+	default:
+		memcpy(dst, src, 4);
+		break;
+	}
+}
+
+/* MOVE THE T-TH OF N LATTICE ELEMENTS FROM STRIDE 1 TO STRIDE K, T <- SPLIT */
+static inline void spread_row(char *dst, const char *src, int size, int k,
+							  int n, int split)
+{
+	for (int t = n - 1; t >= split; t--) // right of the fixed point
+	{
+		copy_element(dst + (size_t)k * t * size, src + (size_t)t * size, size);
+	}
+	for (int t = 0; t < split; t++)
+	{
+		copy_element(dst + (size_t)k * t * size, src + (size_t)t * size, size);
+	}
+}
+
+/* RETURN THE FIRST OF N LATTICE POINTS P0 + K * T RIGHT OF THE FIXED POINT */
+static int lattice_split(int p0, int k, int g, int n)
+{
+	int t = 0;
+	while (t < n && (p0 + k * t) * (k - 1) <= g)
+	{
+		t++;
+	}
+	return t;
+}
+
+/*
+ * Pixel (x, y) of the lattice in [x0,x1)x[y0,y1) gets ((x+gx)/k, (y+gy)/k),
+ * k > 1. Every pixel moves away from the fixed point g / (k - 1), so going
+ * from both ends towards it reads every source before it is overwritten.
+ */
+static void spread_plane(void *plane, int size, int k, int gx, int gy,
+						 int x0, int y0, int x1, int y1)
+{
+	const int nx = (x1 - x0 + k - 1) / k;
+	const int ny = (y1 - y0 + k - 1) / k;
+	const int split_x = lattice_split(x0, k, gx, nx);
+	const int split_y = lattice_split(y0, k, gy, ny);
+	const size_t w = (size_t)comp.grid_w * size; // bytes of one row
+	char *dst = (char *)plane + y0 * w + x0 * size;
+	const char *src = (char *)plane + (y0 + gy) / k * w + (x0 + gx) / k * size;
+	for (int j = ny - 1; j >= split_y; j--) // rows below the fixed point first
+	{
+		spread_row(dst + k * j * w, src + j * w, size, k, nx, split_x);
+	}
+	for (int j = 0; j < split_y; j++)
+	{
+		spread_row(dst + k * j * w, src + j * w, size, k, nx, split_x);
+	}
+}
+
+/*
+ * The view is compared with the shown one. If it is zoomed in k times and
+ * moved so that the old pixel centres fall on the new ones, new pixel x
+ * shows the old (x + gx) / k. A pan (k = 1) moves the grid and sets the
+ * reused rectangle, a zoom spreads the old pixels and marks them in the
+ * lattice mask. The rest is left to compute, k is returned or 0 if nothing
+ * is reused. Nucleo computes whole chunks and so takes only the pans, the
+ * cpu needs the smooth values as well.
+ */
+static int reuse_grid(bool cpu)
+{
+	const view_state *v = &comp.shown;
+	const double k = v->d_re / comp.d_re;
+	const bool valid = comp.shown_valid && v->c_re == comp.c_re &&
+					   v->c_im == comp.c_im && v->n == comp.n &&
+					   v->formula == comp.formula && v->power == comp.power &&
+					   k == v->d_im / comp.d_im && k == round(k) &&
+					   (cpu ? k >= 1 && v->precision >= comp.precision
+							: k == 1) &&
+					   !(cpu && comp.smooth && !comp.smooth_ready);
+	comp.shown_valid = false; // the grid gets overwritten from now on
+	comp.reuse_x0 = comp.reuse_x1 = comp.reuse_y0 = comp.reuse_y1 = 0;
+	comp.reused = 0;
+	if (!valid)
+	{
+		return 0;
+	}
+	const dd re = dd_add_d(dd_add_d(comp.center_re, -v->center_re.hi),
+						   -v->center_re.lo);
+	const dd im = dd_add_d(dd_add_d(comp.center_im, -v->center_im.hi),
+						   -v->center_im.lo);
+	// pixel x lies at centre + (x + 1 - w / 2) * d
+	const double fx = 1 - comp.grid_w / 2. +
+					  k * ((re.hi + re.lo) / v->d_re + comp.grid_w / 2. - 1);
+	const double fy = 1 - comp.grid_h / 2. +
+					  k * ((im.hi + im.lo) / v->d_im + comp.grid_h / 2. - 1);
+	if (fabs(fx - round(fx)) > PAN_EPS || fabs(fy - round(fy)) > PAN_EPS ||
+		fabs(fx) >= k * comp.grid_w || fabs(fy) >= k * comp.grid_h)
+	{
+		return 0;
+	}
+	const int step = k;
+	const int gx = lround(fx);
+	const int gy = lround(fy);
+	// the first lattice column not left of the view, the end behind the last
+	const int x0 = MAX(-gx, (step - gx % step) % step);
+	const int y0 = MAX(-gy, (step - gy % step) % step);
+	const int x1 = MIN(comp.grid_w, step * (comp.grid_w - 1) - gx + 1);
+	const int y1 = MIN(comp.grid_h, step * (comp.grid_h - 1) - gy + 1);
+	if (x0 >= x1 || y0 >= y1)
+	{
+		return 0;
+	}
+	if (step == 1)
+	{
+		shift_plane(comp.grid, comp.cell, gx, gy);
+		shift_plane(comp.grid_computation, comp.cell, gx, gy);
+		comp.reuse_x0 = x0;
+		comp.reuse_x1 = x1;
+		comp.reuse_y0 = y0;
+		comp.reuse_y1 = y1;
+	}
+	else // the lattice of every k-th pixel
+	{
+		spread_plane(comp.grid, comp.cell, step, gx, gy, x0, y0, x1, y1);
+		memset(comp.lattice, 0, comp.grid_w * comp.grid_h);
+		for (int y = y0; y < y1; y += step)
+		{
+			for (int x = x0; x < x1; x += step)
+			{
+				comp.lattice[y * comp.grid_w + x] = 1;
+			}
+		}
+	}
+	if (comp.smooth_ready && step == 1)
+	{
+		shift_plane(comp.smooth, sizeof(float), gx, gy);
+	}
+	else if (comp.smooth_ready)
+	{
+		spread_plane(comp.smooth, sizeof(float), step, gx, gy, x0, y0, x1, y1);
+	}
+	if (comp.orbits_ready && step == 1)
+	{
+		shift_plane(comp.orbit_re, sizeof(double), gx, gy);
+		shift_plane(comp.orbit_im, sizeof(double), gx, gy);
+	}
+	else if (comp.orbits_ready)
+	{
+		spread_plane(comp.orbit_re, sizeof(double), step, gx, gy, x0, y0, x1, y1);
+		spread_plane(comp.orbit_im, sizeof(double), step, gx, gy, x0, y0, x1, y1);
+	}
+	if (comp.antialiased && step == 1)
+	{
+		shift_plane(comp.samples, 1, gx, gy);
+		shift_plane(comp.rgb, 3, gx, gy);
+	}
+	else if (comp.samples) // the supersampling starts again
+	{
+		memset(comp.samples, 0, comp.grid_w * comp.grid_h);
+	}
+	comp.reused = ((x1 - x0 + step - 1) / step) * ((y1 - y0 + step - 1) / step);
+	return step;
+}
+
+/* FILL THE KEY OF THE RECTANGLE, PRECISION -1 FOR THE NUCLEO CHUNKS */
+static void make_key(tile_key *key, int precision, int x, int y, int w, int h)
+{
+	memset(key, 0, sizeof(*key)); // no padding bytes left to the hash
+	key->c_re = comp.c_re;
+	key->c_im = comp.c_im;
+	key->d_re = comp.d_re;
+	key->d_im = comp.d_im;
+	key->re_min = comp.range_re_min;
+	key->im_max = comp.range_im_max;
+	key->center_re = comp.center_re;
+	key->center_im = comp.center_im;
+	key->n = comp.n;
+	key->grid_w = comp.grid_w;
+	key->grid_h = comp.grid_h;
+	key->precision = precision;
+	key->ladder = precision < 0 ? 0 : comp.ladder;
+	key->formula = comp.formula;
+	key->power = comp.power;
+	key->flags = precision < 0 ? 0
+							   : comp.periodicity | comp.subdivision << 1 |
+									 (comp.smooth != NULL) << 2 |
+									 comp.distance << 3;
+	key->x = x;
+	key->y = y;
+	key->w = w;
+	key->h = h;
+}
+
+/* COPY THE RECTANGLE OF THE PLANE TO THE BUFFER OR BACK, RETURN ITS BYTES */
+static int copy_rect(void *plane, int size, int x, int y, int w, int h,
+					 unsigned char *buf, bool pack)
+{
+	for (int row = y; row < y + h; row++)
+	{
+		char *line = (char *)plane + (row * comp.grid_w + x) * size;
+		memcpy(pack ? (char *)buf : line, pack ? line : (char *)buf, w * size);
+		buf += w * size;
+	}
+	return w * h * size;
+}
+
+/* PACK THE TILE TO THE TILE BUFFER OR UNPACK IT, RETURN ITS BYTES */
+static int copy_tile(int x, int y, int w, int h, bool antialiased, bool pack)
+{
+	unsigned char *buf = comp.tile_buf;
+	int len = copy_rect(comp.grid, comp.cell, x, y, w, h, buf, pack);
+	if (comp.smooth)
+	{
+		len += copy_rect(comp.smooth, sizeof(float), x, y, w, h, buf + len, pack);
+	}
+	if (antialiased)
+	{
+		len += copy_rect(comp.samples, 1, x, y, w, h, buf + len, pack);
+		len += copy_rect(comp.rgb, 3, x, y, w, h, buf + len, pack);
+	}
+	return len;
+}
+
+/* SKIP THE CURRENT CHUNK IF THE PAN KEPT ALL OF IT */
+static bool reuse_chunk(void)
+{
+	if (comp.cur_x < comp.reuse_x0 || comp.cur_y < comp.reuse_y0 ||
+		comp.cur_x + comp.chunk_n_re > comp.reuse_x1 ||
+		comp.cur_y + comp.chunk_n_im > comp.reuse_y1)
+	{
+		return false;
+	}
+	for (int y = comp.cur_y; y < comp.cur_y + comp.chunk_n_im; y++)
+	{
+		const int offset = (y * comp.grid_w + comp.cur_x) * comp.cell;
+		memcpy((char *)comp.grid_computation + offset,
+			   (char *)comp.grid + offset, comp.chunk_n_re * comp.cell);
+	}
+	return true;
+}
+
+/* SKIP THE CURRENT CHUNK IF NUCLEO HAS COMPUTED IT FOR THE SAME VIEW BEFORE */
+static bool cache_chunk(void)
+{
+	tile_key key;
+	make_key(&key, -1, comp.cur_x, comp.cur_y, comp.chunk_n_re, comp.chunk_n_im);
+	const int len = comp.chunk_n_re * comp.chunk_n_im * comp.cell;
+	if (!comp.cache_mb || !cache_get(&key, sizeof(key), comp.tile_buf, len))
+	{
+		return false;
+	}
+	copy_rect(comp.grid, comp.cell, comp.cur_x, comp.cur_y, comp.chunk_n_re,
+			  comp.chunk_n_im, comp.tile_buf, false);
+	copy_rect(comp.grid_computation, comp.cell, comp.cur_x, comp.cur_y,
+			  comp.chunk_n_re, comp.chunk_n_im, comp.tile_buf, false);
+	comp.cache_hits++;
+	return true;
+}
+
+/* STORE THE FINISHED CURRENT CHUNK TO THE TILE CACHE */
+static void store_chunk(void)
+{
+	if (!comp.cache_mb)
+	{
+		return;
+	}
+	tile_key key;
+	make_key(&key, -1, comp.cur_x, comp.cur_y, comp.chunk_n_re, comp.chunk_n_im);
+	const int len = copy_rect(comp.grid, comp.cell, comp.cur_x, comp.cur_y,
+							  comp.chunk_n_re, comp.chunk_n_im, comp.tile_buf,
+							  true);
+	cache_put(&key, sizeof(key), comp.tile_buf, len);
+}
+
+/* FILL THE CURRENT CHUNK FROM ITS POINT REFLECTION IF NUCLEO ALREADY SENT IT */
+static bool mirror_chunk(void)
+{
+	symmetry sym;
+	if (!find_symmetry(0, &sym))
+	{
+		return false;
+	}
+	const int mx0 = sym.ox - (comp.cur_x + comp.chunk_n_re - 1);
+	const int mx1 = sym.ox - comp.cur_x;
+	const int my0 = sym.oy - (comp.cur_y + comp.chunk_n_im - 1);
+	const int my1 = sym.oy - comp.cur_y;
+	if (mx0 < 0 || my0 < 0 || mx1 >= comp.grid_w || my1 >= comp.grid_h)
+	{
+		return false;
+	}
+	// chunks go row by row, the bottom right pixel has the highest chunk id
+	const int chunks_in_row = comp.grid_w / comp.chunk_n_re;
+	if ((my1 / comp.chunk_n_im) * chunks_in_row + mx1 / comp.chunk_n_re >=
+		comp.cid)
+	{
+		return false;
+	}
+	for (int y = comp.cur_y; y < comp.cur_y + comp.chunk_n_im; y++)
+	{
+		for (int x = comp.cur_x; x < comp.cur_x + comp.chunk_n_re; x++)
+		{
+			const int src = (sym.oy - y) * comp.grid_w + sym.ox - x;
+			const int dst = y * comp.grid_w + x;
+			cell_set(comp.grid, comp.cell, dst,
+					 cell_get(comp.grid, comp.cell, src));
+			cell_set(comp.grid_computation, comp.cell, dst,
+					 cell_get(comp.grid_computation, comp.cell, src));
+		}
+	}
+	return true;
+}
+
+/* MOVE TO THE NEXT CHUNK, RETURN FALSE IF THE LAST ONE WAS DONE */
+static bool next_chunk(void)
+{
+	comp.cid += 1;
+	if (comp.cid >= comp.nbr_chunks)
+	{
+		return false;
+	}
+	comp.cur_x += comp.chunk_n_re;
+	comp.chunk_re += comp.chunk_n_re * comp.d_re;
+	if (comp.cur_x >= comp.grid_w)
+	{
+		comp.cur_x = 0;
+		comp.chunk_re = comp.range_re_min;
+		comp.chunk_im += comp.chunk_n_im * comp.d_im;
+		comp.cur_y += comp.chunk_n_im;
+	}
+	return true;
+}
+
+/* SEND THE CURRENT CHUNK POSITION TO NUCLEO TO HOLD THE CALCULATION */
+void compute(message *msg)
+{
+	my_assert(msg != NULL, __func__, __LINE__, __FILE__);
+	bool next = true;
+	if (!is_computing()) //first chunk
+	{
+		reuse_grid(false);
+		damage_grid();
+		comp.cache_hits = comp.cache_misses = 0;
+		comp.cid = 0;
+		comp.computing = true;
+		comp.smooth_ready = false; // nucleo sends only the iterations
+		comp.antialiased = false;
+		comp.orbits_ready = false;
+		comp.cur_x = comp.cur_y = 0;
+		comp.chunk_re = comp.range_re_min; //left
+		comp.chunk_im = comp.range_im_max; //up
+	}
+	else //next chunks
+	{
+		next = next_chunk();
+	}
+	while (next) // the mirrored, reused and cached ones are not sent at all
+	{
+		if (mirror_chunk())
+		{
+			INFOF("Chunk %d mirrored from its point reflection\n", comp.cid);
+			store_chunk();
+		}
+		else if (reuse_chunk())
+		{
+			INFOF("Chunk %d kept from the panned view\n", comp.cid);
+			store_chunk();
+		}
+		else if (cache_chunk())
+		{
+			INFOF("Chunk %d taken from the tile cache\n", comp.cid);
+		}
+		else
+		{
+			break;
+		}
+		damage_rect(comp.cur_x, comp.cur_y, comp.chunk_n_re, comp.chunk_n_im);
+		next = next_chunk();
+	}
+	if (next)
+	{
+		msg->type = MSG_COMPUTE;
+		comp.cache_misses++;
+	}
+	else if (comp.cid >= comp.nbr_chunks) // the rest was mirrored or reused
+	{
+		comp.done = true;
+		comp.computing = false;
+		remember_view(PRECISION_DOUBLE);
+	}
+	if (comp.computing && msg->type == MSG_COMPUTE) //calculation saved to msg
+	{
+		msg->data.compute.cid = comp.cid;
+		msg->data.compute.re = comp.chunk_re;
+		msg->data.compute.im = comp.chunk_im;
+		msg->data.compute.n_re = comp.chunk_n_re;
+		msg->data.compute.n_im = comp.chunk_n_im;
+	}
+}
+
+/* RETURN TRUE IF THE COMPUTATION IS ABORTED */
+bool is_abort(void)
+{
+	return comp.abort;
+}
+
+/* UPDATE STRUCT WITH ACTUAL VALUES AND OCASIONALLY STOPS THE CALCULATION */
+void update_data(const msg_compute_data *compute_data)
+{
+	my_assert(compute_data != NULL, __func__, __LINE__, __FILE__);
+	if (compute_data->cid == comp.cid)
+	{
+		const int idx = comp.cur_x + compute_data->i_re +
+						(comp.cur_y + compute_data->i_im) * comp.grid_w;
+		if (idx >= 0 && idx < comp.grid_h * comp.grid_w)
+		{
+			cell_set(comp.grid, comp.cell, idx, compute_data->iter);
+			cell_set(comp.grid_computation, comp.cell, idx, compute_data->iter);
+			damage_rect(idx % comp.grid_w, idx / comp.grid_w, 1, 1);
+		}
+		if ((compute_data->i_re + 1) == comp.chunk_n_re &&
+			(compute_data->i_im + 1) == comp.chunk_n_im) // last pixel
+		{
+			store_chunk();
+		}
+		if ((comp.cid + 1) >= comp.nbr_chunks &&
+			(compute_data->i_re + 1) == comp.chunk_n_re &&
+			(compute_data->i_im + 1) == comp.chunk_n_im)
+		{
+			comp.done = true;
+			comp.computing = false;
+			remember_view(PRECISION_DOUBLE);
+		}
+	}
+	else
+	{
+		ERROR("Recieved chunk with unexpected chunkid\n");
+	}
+}
+
+/* MAKE THE PALETTE TABLE OF THE CURRENT N, ONLY ON THE BOSS THREAD */
+static void update_colors(void)
+{
+	if (comp.table_n != comp.n)
+	{
+		free(comp.colors);
+		comp.colors = palette_table(comp.n);
+		comp.table_n = comp.n;
+	}
+}
+
+/* WHERE THE ROWS OF A RECTANGLE ARE COLORED TO, RGB OR 32 BIT PIXELS */
+typedef struct
+{
+	grid_rect rect;
+	unsigned char *img; // packed rgb of the whole grid, NULL for the pixels
+	uint32_t *pixels;	// top left pixel of the rectangle
+	int pitch;			// bytes from one row of the pixels to the next
+	pixel_format format;
+	int rows; // rows of one band
+} image_job;
+
+/* COLOR THE ROW Y OF THE RECTANGLE */
+static void image_row(const image_job *job, int y)
+{
+	const int w = job->rect.w;
+	const int first = y * comp.grid_w + job->rect.x;
+	unsigned char *rgb = job->img ? job->img + 3 * first : NULL;
+	uint32_t *pixels =
+		job->img ? NULL
+				 : (uint32_t *)((char *)job->pixels +
+								(size_t)(y - job->rect.y) * job->pitch);
+	const void *values = (char *)comp.grid + first * comp.cell;
+	if (!comp.smooth_ready && rgb)
+	{
+		palette_map(comp.colors, comp.n, values, comp.cell, w, rgb);
+	}
+	else if (!comp.smooth_ready)
+	{
+		palette_pixels(comp.pixel_colors, job->format, comp.n, values,
+					   comp.cell, w, pixels);
+	}
+	for (int x = 0; x < w; x++)
+	{
+		const int i = first + x;
+		const bool sampled = comp.antialiased && comp.samples[i];
+		if (!sampled && !comp.smooth_ready)
+		{
+			continue;
+		}
+		unsigned char color[3];
+		if (sampled)
+		{
+			memcpy(color, comp.rgb + 3 * i, 3);
+		}
+		else // between the iterations, no table
+		{
+			palette_color(comp.smooth[i], comp.n, color);
+		}
+		if (rgb)
+		{
+			memcpy(rgb + 3 * x, color, 3);
+		}
+		else
+		{
+			pixels[x] = palette_pixel(color, job->format);
+		}
+	}
+}
+
+/* COLOR ONE BAND OF THE ROWS OF THE RECTANGLE */
+static void image_band(int band, void *arg)
+{
+	const image_job *job = (const image_job *)arg;
+	const int first = job->rect.y + band * job->rows;
+	const int last = MIN(first + job->rows, job->rect.y + job->rect.h);
+	for (int y = first; y < last; y++)
+	{
+		image_row(job, y);
+	}
+}
+
+/* SHARE THE BANDS OF THE ROWS OUT TO THE POOL */
+static void color_rect(image_job *job)
+{
+	job->rows = MAX(1, IMAGE_BAND / MAX(job->rect.w, 1));
+	pool_run((job->rect.h + job->rows - 1) / job->rows, image_band, job);
+}
+
+/* UPDATES THE RGB IMAGE VALUES, THE BANDS ARE SHARED OUT TO THE POOL */
+void update_image(int w, int h, unsigned char *img)
+{
+	my_assert(img && comp.grid && w == comp.grid_w && h == comp.grid_h,
+			  __func__, __LINE__, __FILE__);
+	update_colors();
+	image_job job = {.rect = {.w = w, .h = h}, .img = img};
+	color_rect(&job);
+}
+
+/*
+ * Color the rectangle of the grid straight into the 32 bit pixels of the
+ * format, its rows pitch bytes apart, e.g. a locked part of the window
+ * texture. The table of the pixels is kept apart from the rgb one, both
+ * are made on the boss thread.
+ */
+void update_pixels(const grid_rect *rect, uint32_t *pixels, int pitch,
+				   pixel_format format)
+{
+	my_assert(pixels && comp.grid && rect->x >= 0 && rect->y >= 0 &&
+				  rect->x + rect->w <= comp.grid_w &&
+				  rect->y + rect->h <= comp.grid_h,
+			  __func__, __LINE__, __FILE__);
+	if (comp.pixel_n != comp.n || comp.format.r != format.r ||
+		comp.format.g != format.g || comp.format.b != format.b ||
+		comp.format.a != format.a)
+	{
+		free(comp.pixel_colors);
+		comp.pixel_colors = palette_pixel_table(comp.n, format);
+		comp.pixel_n = comp.n;
+		comp.format = format;
+	}
+	image_job job = {
+		.rect = *rect, .pixels = pixels, .pitch = pitch, .format = format};
+	color_rect(&job);
+}
+
+/* SET THE COMPUTATION ABORT ON TRUE */
+void abort_comp(void)
+{
+	memset(comp.grid_computation, 0,
+		   comp.grid_w * comp.grid_h * comp.cell); // used for p cmd
+	comp.computing = false;
+	comp.abort = true;
+}
+
+/* SAVE PICTURE RESOLUTION TO VARIABLES  */
+void get_grid_size(int *width, int *height)
+{
+	*width = comp.grid_w;
+	*height = comp.grid_h;
+}
+
+/* RETURNS PICTURE WIDTH */
+int grid_width()
+{
+	return comp.grid_w;
+}
+
+/* RETURN PICTURE HEIGHT */
+int grid_height()
+{
+	return comp.grid_h;
+}
+
+/* RETURN THE NUMBER OF CHUNKS */
+int number_of_chunks()
+{
+	return comp.nbr_chunks;
+}
+
+/* RETURN THE POSITION ON REAL AXES */
+int cursor_width()
+{
+	return comp.cur_x;
+}
+
+/* RETURN THE POSITION ON IMAGINARY AXES */
+int cursor_height()
+{
+	return comp.cur_y;
+}
+
+/* RETURN TRUE IF THE USER INPUT IS DIVISIBLE - MODULO IS ZERO */
+bool correct_input()
+{
+	return (comp.grid_w % comp.chunk_n_re == 0 &&
+			comp.grid_h % comp.chunk_n_im == 0);
+}
+
+/* COMPUTE THE NUMBER OF ITERATIONS FOR PIXEL PX PY */
+uint32_t compute_iter(double cx, double cy, double px,
+					  double py, uint32_t max_iteration)
+{
+	uint32_t ret = 0;
+	while (ret <= max_iteration && px * px + py * py < 4)
+	{
+		double temp = px * px - py * py + cx;
+		py = 2 * px * py + cy;
+		px = temp;
+		ret++;
+	}
+	return ret;
+}
+
+/*
+ * The same iterations as compute_iter() with the derivative dz/dz0 along.
+ * An escaped orbit runs on to a large |z|, the distance of the pixel to the
+ * julia set is then about |z| log|z| / 2|dz|. The interior pixels get 0.
+ * Mag is the squared |z| the orbit escaped with, used by the smooth coloring.
+ */
+uint32_t compute_distance(double cx, double cy, double px, double py,
+						  uint32_t max_iteration, double *distance, float *mag)
+{
+	double dx = 1, dy = 0;
+	uint32_t ret = 0;
+	while (ret <= max_iteration && px * px + py * py < 4)
+	{
+		const double temp_d = 2 * (px * dx - py * dy);
+		dy = 2 * (px * dy + py * dx);
+		dx = temp_d;
+		double temp = px * px - py * py + cx;
+		py = 2 * px * py + cy;
+		px = temp;
+		ret++;
+	}
+	*distance = 0;
+	*mag = 0;
+	if (ret <= max_iteration)
+	{
+		*mag = px * px + py * py;
+		while (px * px + py * py < DE_RADIUS)
+		{
+			const double temp_d = 2 * (px * dx - py * dy);
+			dy = 2 * (px * dy + py * dx);
+			dx = temp_d;
+			double temp = px * px - py * py + cx;
+			py = 2 * px * py + cy;
+			px = temp;
+		}
+		const double r2 = px * px + py * py;
+		*distance = 0.25 * sqrt(r2 / (dx * dx + dy * dy)) * log(r2);
+	}
+	return ret;
+}
+
+/* ONE CPU RENDERING SPLIT TO TILES FOR THE WORKER POOL */
+typedef struct
+{
+	kernel_params params;  // constant, iterations and periodicity check
+	const double *re;	   // real coordinate of every column
+	const double *im;	   // imaginary coordinate of every row
+	void *grid;			   // output, cell bytes per pixel
+	int cell;			   // bytes per pixel of the grid
+	float *smooth;		   // continuous escape values, NULL if not wanted
+	uint8_t *samples;	   // samples of every pixel, NULL without supersampling
+	unsigned char *rgb;	   // averaged color of the supersampled pixels
+	double d_re;		   // pixel size, the samples are spread over it
+	double d_im;
+	int grid_w;			   // resolution - width
+	int grid_h;			   // resolution - height
+	int tiles_x;		   // number of tiles in one row
+	bool subdivision;	   // use the mariani-silver algorithm
+	bool deep;			   // re and im are offsets from the reference orbit
+	uint8_t *mask;		   // band edges recomputed by the mixed pass
+	int skip_x0;		   // [skip_x0, skip_x1) x [skip_y0, skip_y1) is
+	int skip_y0;		   // mirrored afterwards and not computed
+	int skip_x1;
+	int skip_y1;
+	int step;			   // block edge of the coarse pass, 1 at the end
+	int known;			   // pixels on multiples of it are done, 0 if none
+	uint8_t *lattice;	   // pixels kept from before the zoom, NULL if none
+	const uint8_t *cached; // tiles taken from the tile cache, NULL if none
+	double *z_re;		   // last orbit point of every pixel, NULL if not kept
+	double *z_im;
+	uint32_t resume;	   // the interior value the orbits are continued from
+	int cycles;			   // pixels stopped by the periodicity check
+	int computed;		   // pixels really iterated
+	int refined;		   // pixels recomputed in double by the mixed pass
+	int supersampled;	   // pixels supersampled on the boundary
+	int resumed;		   // interior pixels continued from their orbits
+	int escaped;		   // of them escaped with the higher iterations
+} render_job;
+
+/*
+ * Pixels [x0, x1) x [y0, y1) of the tile, the last row and column of tiles
+ * are cut by the grid. False if the tile came final from the tile cache and
+ * the workers have nothing to do with it.
+ */
+static bool tile_bounds(const render_job *job, int tile, int *x0, int *y0,
+						int *x1, int *y1)
+{
+	*x0 = (tile % job->tiles_x) * TILE_SIZE;
+	*y0 = (tile / job->tiles_x) * TILE_SIZE;
+	*x1 = MIN(*x0 + TILE_SIZE, job->grid_w);
+	*y1 = MIN(*y0 + TILE_SIZE, job->grid_h);
+	return !(job->cached && job->cached[tile]);
+}
+
+/*
+ * Continuous escape value for the smooth coloring, iter + 1 - log2(log2 |z|)
+ * falls from iter + 1 to iter as the escaped |z| grows from 2 to 4, so the
+ * bands of the same iterations blend into each other. The power d takes the
+ * logarithm of base d, |z| grows from 2 to 2^d in one step.
+ */
+static inline float smooth_value(uint32_t iter, float mag,
+								 const kernel_params *p)
+{
+	return mag < 4 ? p->max_iteration + 1.0f // interior, no escape
+				   : iter + 1 - log2f(0.5f * log2f(mag)) / log2f(p->power);
+}
+
+/* STORE THE RESULTS OF COUNT PIXELS TO THE GRID INDICES IDX */
+static void store_points(const render_job *job, const int *idx,
+						 const uint32_t *out, const float *mag,
+						 const double *z_re, const double *z_im, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		cell_set(job->grid, job->cell, idx[i], out[i]);
+	}
+	for (int i = 0; i < count && job->smooth; i++)
+	{
+		job->smooth[idx[i]] =
+			smooth_value(out[i], mag[i], &job->params);
+	}
+	for (int i = 0; i < count && z_re; i++)
+	{
+		job->z_re[idx[i]] = z_re[i];
+		job->z_im[idx[i]] = z_im[i];
+	}
+}
+
+/* ITERATE COUNT POINTS AND STORE THEM TO THE GRID INDICES IDX */
+static int compute_points(const render_job *job, const double *re,
+						  const double *im, const int *idx, int count)
+{
+	uint32_t out[TILE_SIZE];
+	float mag[TILE_SIZE];
+	double z_re[TILE_SIZE];
+	double z_im[TILE_SIZE];
+	float *exit_mag = job->smooth ? mag : NULL;
+	const bool orbits = job->z_re != NULL;
+	const int cycles = job->deep ? perturbation_points(&job->params, re, im,
+													   count, out, exit_mag)
+								 : kernel_points(&job->params, re, im, count,
+												 out, exit_mag,
+												 orbits ? z_re : NULL, z_im);
+	store_points(job, idx, out, mag, orbits ? z_re : NULL, z_im, count);
+	return cycles;
+}
+
+/* RETURN TRUE IF THE ZOOM HAS KEPT THE PIXEL */
+static inline bool is_kept(const render_job *job, int x, int y)
+{
+	return job->lattice && job->lattice[y * job->grid_w + x];
+}
+
+/* RETURN TRUE IF AN EARLIER PASS HAS ALREADY COMPUTED OR KEPT THE PIXEL */
+static inline bool is_known(const render_job *job, int x, int y)
+{
+	return (job->known && x % job->known == 0 && y % job->known == 0) ||
+		   is_kept(job, x, y);
+}
+
+/*
+ * Iterate [x0,x1]x[y0,y1] inclusive, gathered to keep all SIMD lanes busy.
+ * The pixels of the earlier coarse passes are left out.
+ */
+static int compute_rect(const render_job *job, int x0, int y0, int x1, int y1,
+						int *computed)
+{
+	double re[TILE_SIZE];
+	double im[TILE_SIZE];
+	int idx[TILE_SIZE];
+	int count = 0;
+	int cycles = 0;
+	for (int y = y0; y <= y1; y++)
+	{
+		for (int x = x0; x <= x1; x++)
+		{
+			if (is_known(job, x, y))
+			{
+				continue;
+			}
+			re[count] = job->re[x];
+			im[count] = job->im[y];
+			idx[count++] = y * job->grid_w + x;
+			if (count == TILE_SIZE)
+			{
+				cycles += compute_points(job, re, im, idx, count);
+				*computed += count;
+				count = 0;
+			}
+		}
+	}
+	if (count > 0)
+	{
+		cycles += compute_points(job, re, im, idx, count);
+		*computed += count;
+	}
+	return cycles;
+}
+
+/* RETURN TRUE IF THE KNOWN BORDER OF THE RECTANGLE HAS ONE VALUE */
+static bool is_uniform_border(const render_job *job, int x0, int y0,
+							  int x1, int y1)
+{
+	const void *grid = job->grid;
+	const int cell = job->cell;
+	const int w = job->grid_w;
+	const uint32_t value = cell_get(grid, cell, y0 * w + x0);
+	for (int x = x0; x <= x1; x++)
+	{
+		if (cell_get(grid, cell, y0 * w + x) != value ||
+			cell_get(grid, cell, y1 * w + x) != value)
+		{
+			return false;
+		}
+	}
+	for (int y = y0 + 1; y < y1; y++)
+	{
+		if (cell_get(grid, cell, y * w + x0) != value ||
+			cell_get(grid, cell, y * w + x1) != value)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Mariani-Silver subdivision, the border of [x0,x1]x[y0,y1] (inclusive) is
+ * already computed. A uniform border means the whole rectangle has the same
+ * value because the filled julia set is connected, otherwise the rectangle
+ * is split by one row and one column and the quarters are checked again.
+ * The smooth values differ inside an escaped band, only interior is filled.
+ */
+static void subdivide(render_job *job, int x0, int y0, int x1, int y1,
+					  int *cycles, int *computed)
+{
+	if (x1 - x0 < 2 || y1 - y0 < 2) // no inner pixel
+	{
+		return;
+	}
+	const uint32_t value = cell_get(job->grid, job->cell, y0 * job->grid_w + x0);
+	if (is_uniform_border(job, x0, y0, x1, y1) &&
+		(!job->smooth || value > job->params.max_iteration))
+	{
+		for (int y = y0 + 1; y < y1; y++)
+		{
+			for (int x = x0 + 1; x < x1; x++)
+			{
+				cell_set(job->grid, job->cell, y * job->grid_w + x, value);
+			}
+			for (int x = x0 + 1; x < x1 && job->smooth; x++)
+			{
+				job->smooth[y * job->grid_w + x] = value;
+			}
+			for (int x = x0 + 1; x < x1 && job->z_re; x++) // no orbit, redone
+			{
+				job->z_re[y * job->grid_w + x] = NAN;
+			}
+		}
+		return;
+	}
+	if (x1 - x0 <= MIN_SUBDIVISION || y1 - y0 <= MIN_SUBDIVISION)
+	{
+		*cycles += compute_rect(job, x0 + 1, y0 + 1, x1 - 1, y1 - 1, computed);
+		return;
+	}
+	const int xm = (x0 + x1) / 2;
+	const int ym = (y0 + y1) / 2;
+	*cycles += compute_rect(job, x0 + 1, ym, x1 - 1, ym, computed);
+	*cycles += compute_rect(job, xm, y0 + 1, xm, ym - 1, computed);
+	*cycles += compute_rect(job, xm, ym + 1, xm, y1 - 1, computed);
+	subdivide(job, x0, y0, xm, ym, cycles, computed);
+	subdivide(job, xm, y0, x1, ym, cycles, computed);
+	subdivide(job, x0, ym, xm, y1, cycles, computed);
+	subdivide(job, xm, ym, x1, y1, cycles, computed);
+}
+
+/* RENDER THE RECTANGLE [X0,X1)x[Y0,Y1) OF THE JOB */
+static void render_rect(render_job *job, int x0, int y0, int x1, int y1,
+						int *cycles, int *computed)
+{
+	if (x0 >= x1 || y0 >= y1)
+	{
+		return;
+	}
+	if (job->subdivision && x1 - x0 > 2 && y1 - y0 > 2) // border, subdivide
+	{
+		*cycles += compute_rect(job, x0, y0, x1 - 1, y0, computed);
+		*cycles += compute_rect(job, x0, y1 - 1, x1 - 1, y1 - 1, computed);
+		*cycles += compute_rect(job, x0, y0 + 1, x0, y1 - 2, computed);
+		*cycles += compute_rect(job, x1 - 1, y0 + 1, x1 - 1, y1 - 2, computed);
+		subdivide(job, x0, y0, x1 - 1, y1 - 1, cycles, computed);
+	}
+	else if (job->deep || job->lattice) // gathered, the kept pixels are gaps
+	{
+		*cycles += compute_rect(job, x0, y0, x1 - 1, y1 - 1, computed);
+	}
+	else // the rectangle lies in one tile, the row fits
+	{
+		uint32_t out[TILE_SIZE];
+		float mag[TILE_SIZE];
+		int idx[TILE_SIZE];
+		for (int y = y0; y < y1; y++)
+		{
+			if (job->known && y % job->known == 0) // gaps after coarse passes
+			{
+				*cycles += compute_rect(job, x0, y, x1 - 1, y, computed);
+				continue;
+			}
+			const int row = y * job->grid_w;
+			*cycles += kernel_row(&job->params, job->re + x0, job->im[y],
+								  x1 - x0, out, job->smooth ? mag : NULL,
+								  job->z_re ? job->z_re + row + x0 : NULL,
+								  job->z_im ? job->z_im + row + x0 : NULL);
+			for (int x = x0; x < x1; x++)
+			{
+				idx[x - x0] = row + x;
+			}
+			store_points(job, idx, out, mag, NULL, NULL, x1 - x0);
+			*computed += x1 - x0;
+		}
+	}
+}
+
+/* COMPUTE ONE TILE OF THE JOB EXCEPT THE MIRRORED PART */
+static void render_tile(int tile, void *arg)
+{
+	render_job *job = (render_job *)arg;
+	int x0, y0, x1, y1;
+	if (!tile_bounds(job, tile, &x0, &y0, &x1, &y1))
+	{
+		return;
+	}
+	const int sx0 = MAX(x0, job->skip_x0);
+	const int sy0 = MAX(y0, job->skip_y0);
+	const int sx1 = MIN(x1, job->skip_x1);
+	const int sy1 = MIN(y1, job->skip_y1);
+	int cycles = 0;
+	int computed = 0;
+	if (sx0 >= sx1 || sy0 >= sy1) // nothing to skip
+	{
+		render_rect(job, x0, y0, x1, y1, &cycles, &computed);
+	}
+	else // up to four rectangles around the skipped one
+	{
+		render_rect(job, x0, y0, x1, sy0, &cycles, &computed);
+		render_rect(job, x0, sy1, x1, y1, &cycles, &computed);
+		render_rect(job, x0, sy0, sx0, sy1, &cycles, &computed);
+		render_rect(job, sx1, sy0, x1, sy1, &cycles, &computed);
+	}
+	__atomic_add_fetch(&job->cycles, cycles, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&job->computed, computed, __ATOMIC_RELAXED);
+}
+
+/*
+ * One coarse pass over the tile, the top left pixel of every step x step
+ * block is iterated and its value fills the block. The pixels of the earlier
+ * pass are kept, the skipped part is left to the mirror or the pan reuse.
+ */
+static void preview_tile(int tile, void *arg)
+{
+	render_job *job = (render_job *)arg;
+	int x0, y0, x1, y1;
+	if (!tile_bounds(job, tile, &x0, &y0, &x1, &y1))
+	{
+		return;
+	}
+	const int s = job->step;
+	double re[TILE_SIZE];
+	double im[TILE_SIZE];
+	int idx[TILE_SIZE];
+	int count = 0;
+	int cycles = 0;
+	int computed = 0;
+	for (int y = y0; y < y1; y += s)
+	{
+		for (int x = x0; x < x1; x += s)
+		{
+			const bool skipped = x >= job->skip_x0 && y >= job->skip_y0 &&
+								 MIN(x + s, x1) <= job->skip_x1 &&
+								 MIN(y + s, y1) <= job->skip_y1;
+			if (skipped || is_known(job, x, y))
+			{
+				continue;
+			}
+			re[count] = job->re[x];
+			im[count] = job->im[y];
+			idx[count++] = y * job->grid_w + x;
+			if (count == TILE_SIZE)
+			{
+				cycles += compute_points(job, re, im, idx, count);
+				computed += count;
+				count = 0;
+			}
+		}
+	}
+	if (count > 0)
+	{
+		cycles += compute_points(job, re, im, idx, count);
+		computed += count;
+	}
+	for (int y = y0; y < y1; y++) // fill the blocks from their corners
+	{
+		const int row = y * job->grid_w;
+		const int corner_row = (y - y % s) * job->grid_w;
+		const bool skipped_row = y >= job->skip_y0 && y < job->skip_y1;
+		for (int x = x0; x < x1; x++)
+		{
+			if ((skipped_row && x >= job->skip_x0 && x < job->skip_x1) ||
+				is_kept(job, x, y))
+			{
+				continue;
+			}
+			cell_set(job->grid, job->cell, row + x,
+					 cell_get(job->grid, job->cell, corner_row + x - x % s));
+			if (job->smooth)
+			{
+				job->smooth[row + x] = job->smooth[corner_row + x - x % s];
+			}
+		}
+	}
+	__atomic_add_fetch(&job->cycles, cycles, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&job->computed, computed, __ATOMIC_RELAXED);
+}
+
+/*
+ * Mark the band edges of the tile, the pixels which differ from some of their
+ * neighbours. Float rounding moves the edges only where the orbits are long,
+ * so the first quarter of the iterations is left alone.
+ */
+static void mark_tile(int tile, void *arg)
+{
+	render_job *job = (render_job *)arg;
+	int x0, y0, x1, y1;
+	if (!tile_bounds(job, tile, &x0, &y0, &x1, &y1))
+	{
+		return;
+	}
+	const int w = job->grid_w;
+	const void *g = job->grid;
+	const int c = job->cell;
+	for (int y = y0; y < y1; y++)
+	{
+		for (int x = x0; x < x1; x++)
+		{
+			const int i = y * w + x;
+			const uint32_t v = cell_get(g, c, i);
+			job->mask[i] = v > job->params.max_iteration / 4 &&
+						   ((x > 0 && cell_get(g, c, i - 1) != v) ||
+							(x + 1 < w && cell_get(g, c, i + 1) != v) ||
+							(y > 0 && cell_get(g, c, i - w) != v) ||
+							(y + 1 < job->grid_h && cell_get(g, c, i + w) != v));
+		}
+	}
+}
+
+/* RECOMPUTE THE MARKED PIXELS OF THE TILE IN DOUBLE, SKIPPED ONES EXCLUDED */
+static void refine_tile(int tile, void *arg)
+{
+	render_job *job = (render_job *)arg;
+	int x0, y0, x1, y1;
+	if (!tile_bounds(job, tile, &x0, &y0, &x1, &y1))
+	{
+		return;
+	}
+	double re[TILE_SIZE];
+	double im[TILE_SIZE];
+	uint32_t out[TILE_SIZE];
+	float mag[TILE_SIZE];
+	int idx[TILE_SIZE];
+	int count = 0;
+	int refined = 0;
+	for (int y = y0; y < y1; y++)
+	{
+		for (int x = x0; x < x1; x++)
+		{
+			const bool skipped = x >= job->skip_x0 && x < job->skip_x1 &&
+								 y >= job->skip_y0 && y < job->skip_y1;
+			if (job->mask[y * job->grid_w + x] && !skipped)
+			{
+				re[count] = job->re[x];
+				im[count] = job->im[y];
+				idx[count++] = y * job->grid_w + x;
+			}
+			if (count == TILE_SIZE || (count > 0 && y == y1 - 1 && x == x1 - 1))
+			{
+				kernel_points(&job->params, re, im, count, out,
+							  job->smooth ? mag : NULL, NULL, NULL);
+				store_points(job, idx, out, mag, NULL, NULL, count);
+				refined += count;
+				count = 0;
+			}
+		}
+	}
+	__atomic_add_fetch(&job->refined, refined, __ATOMIC_RELAXED);
+}
+
+/* RETURN TRUE IF SOME 4-NEIGHBOUR OF THE PIXEL HAS A DIFFERENT VALUE */
+static bool is_band_edge(const render_job *job, int x, int y)
+{
+	const void *g = job->grid;
+	const int c = job->cell;
+	const int w = job->grid_w;
+	const int i = y * w + x;
+	const uint32_t v = cell_get(g, c, i);
+	return (x > 0 && cell_get(g, c, i - 1) != v) ||
+		   (x + 1 < w && cell_get(g, c, i + 1) != v) ||
+		   (y > 0 && cell_get(g, c, i - w) != v) ||
+		   (y + 1 < job->grid_h && cell_get(g, c, i + w) != v);
+}
+
+/*
+ * Average the colors of S x S samples spread regularly over every listed
+ * pixel. The samples of several pixels are iterated together to fill the
+ * SIMD lanes. The pixels whose samples differ are moved to the front of the
+ * list, their number is returned.
+ */
+static int supersample(const render_job *job, int *pixels, int count, int s)
+{
+	double re[TILE_SIZE];
+	double im[TILE_SIZE];
+	uint32_t out[TILE_SIZE];
+	float mag[TILE_SIZE];
+	const int per_pixel = s * s;
+	const int per_call = TILE_SIZE / per_pixel;
+	const uint32_t max = job->params.max_iteration;
+	int differ = 0;
+	for (int first = 0; first < count; first += per_call)
+	{
+		const int n = MIN(per_call, count - first);
+		for (int p = 0; p < n; p++)
+		{
+			const int x = pixels[first + p] % job->grid_w;
+			const int y = pixels[first + p] / job->grid_w;
+			for (int j = 0; j < per_pixel; j++)
+			{
+				re[p * per_pixel + j] =
+					job->re[x] + ((j % s + 0.5) / s - 0.5) * job->d_re;
+				im[p * per_pixel + j] =
+					job->im[y] + ((j / s + 0.5) / s - 0.5) * job->d_im;
+			}
+		}
+		kernel_points(&job->params, re, im, n * per_pixel, out,
+					  job->smooth ? mag : NULL, NULL, NULL);
+		for (int p = 0; p < n; p++)
+		{
+			const uint32_t *o = out + p * per_pixel;
+			const int i = pixels[first + p];
+			int sum[3] = {0, 0, 0};
+			bool uniform = true;
+			for (int j = 0; j < per_pixel; j++)
+			{
+				unsigned char color[3];
+				palette_color(job->smooth ? smooth_value(o[j], mag[p * per_pixel + j],
+												   &job->params)
+									: o[j],
+						max, color);
+				for (int k = 0; k < 3; k++)
+				{
+					sum[k] += color[k];
+				}
+				uniform = uniform && o[j] == o[0];
+			}
+			for (int k = 0; k < 3; k++)
+			{
+				job->rgb[3 * i + k] = (sum[k] + per_pixel / 2) / per_pixel;
+			}
+			job->samples[i] = per_pixel;
+			if (!uniform) // never overwrites a pixel not yet read
+			{
+				pixels[differ++] = i;
+			}
+		}
+	}
+	return differ;
+}
+
+/*
+ * Only the pixels closer to the boundary than their size are supersampled,
+ * 2 x 2 if the estimate is below one pixel. Below a quarter of it the pixel
+ * goes on to 4 x 4 samples unless the first 2 x 2 of them agree.
+ * The bands of the iterations narrow down towards the boundary, so the
+ * estimate is needed only on the band edges, a pixel inside a band keeps its
+ * single sample. The estimate says nothing inside the set, the interior
+ * pixels next to an escaped one are handled as the closest ones. The
+ * estimate follows the derivative of z^2 + c, the boundary pixels of the
+ * other formulas are all handled as the closest ones.
+ */
+static void estimate_tile(int tile, void *arg)
+{
+	render_job *job = (render_job *)arg;
+	int x0, y0, x1, y1;
+	if (!tile_bounds(job, tile, &x0, &y0, &x1, &y1))
+	{
+		return;
+	}
+	const double size = MAX(fabs(job->d_re), fabs(job->d_im));
+	const bool estimate = job->params.formula == FORMULA_JULIA &&
+						  job->params.power == 2;
+	int near[TILE_SIZE * TILE_SIZE]; // supersampled 2 x 2
+	int nearest[TILE_SIZE * TILE_SIZE]; // 2 x 2 first, then 4 x 4
+	int nbr_near = 0;
+	int nbr_nearest = 0;
+	for (int y = y0; y < y1; y++)
+	{
+		for (int x = x0; x < x1; x++)
+		{
+			const int i = y * job->grid_w + x;
+			const bool skipped = x >= job->skip_x0 && x < job->skip_x1 &&
+								 y >= job->skip_y0 && y < job->skip_y1;
+			if (skipped)
+			{
+				continue;
+			}
+			job->samples[i] = 0;
+			if (!is_band_edge(job, x, y))
+			{
+				continue;
+			}
+			double distance = 0;
+			if (estimate &&
+				cell_get(job->grid, job->cell, i) <= job->params.max_iteration)
+			{
+				float mag;
+				compute_distance(job->params.c_re, job->params.c_im, job->re[x],
+								 job->im[y], job->params.max_iteration,
+								 &distance, &mag);
+			}
+			if (!(distance >= size / 4)) // overflowed derivative as well
+			{
+				nearest[nbr_nearest++] = i;
+			}
+			else if (distance < size)
+			{
+				near[nbr_near++] = i;
+			}
+		}
+	}
+	supersample(job, near, nbr_near, 2);
+	const int differ = supersample(job, nearest, nbr_nearest, 2);
+	supersample(job, nearest, differ, DE_SUPERSAMPLE);
+	__atomic_add_fetch(&job->supersampled, nbr_near + nbr_nearest,
+					   __ATOMIC_RELAXED);
+}
+
+/* CONTINUE COUNT ORBITS FROM THEIR LAST POINTS, RETURN THE CYCLE EXITS */
+static int continue_points(const render_job *job, const kernel_params *cont,
+						   double *z_re, double *z_im, const int *idx,
+						   int count, int *escaped)
+{
+	uint32_t out[TILE_SIZE];
+	float mag[TILE_SIZE];
+	// the kernel reads the whole block before it stores the new points
+	const int cycles = kernel_points(cont, z_re, z_im, count, out,
+									 job->smooth ? mag : NULL, z_re, z_im);
+	for (int i = 0; i < count; i++)
+	{
+		out[i] += job->resume;
+		*escaped += out[i] <= job->params.max_iteration;
+	}
+	store_points(job, idx, out, mag, z_re, z_im, count);
+	return cycles;
+}
+
+/*
+ * Continue the interior pixels of the tile from their last orbit points with
+ * the higher number of iterations, the escaped ones keep their values. The
+ * pixels whose orbit was not kept are iterated from the start again.
+ */
+static void resume_tile(int tile, void *arg)
+{
+	render_job *job = (render_job *)arg;
+	int x0, y0, x1, y1;
+	if (!tile_bounds(job, tile, &x0, &y0, &x1, &y1))
+	{
+		return;
+	}
+	kernel_params cont = job->params;
+	cont.max_iteration -= job->resume; // the iterations already done
+	double z_re[TILE_SIZE];
+	double z_im[TILE_SIZE];
+	double re[TILE_SIZE];
+	double im[TILE_SIZE];
+	int idx[TILE_SIZE];
+	int fresh[TILE_SIZE];
+	int count = 0;
+	int nbr_fresh = 0;
+	int cycles = 0;
+	int computed = 0;
+	int resumed = 0;
+	int escaped = 0;
+	for (int y = y0; y < y1; y++)
+	{
+		for (int x = x0; x < x1; x++)
+		{
+			const int i = y * job->grid_w + x;
+			const bool skipped = x >= job->skip_x0 && x < job->skip_x1 &&
+								 y >= job->skip_y0 && y < job->skip_y1;
+			if (skipped || cell_get(job->grid, job->cell, i) != job->resume)
+			{
+				continue;
+			}
+			if (isnan(job->z_re[i]))
+			{
+				re[nbr_fresh] = job->re[x];
+				im[nbr_fresh] = job->im[y];
+				fresh[nbr_fresh++] = i;
+			}
+			else
+			{
+				z_re[count] = job->z_re[i];
+				z_im[count] = job->z_im[i];
+				idx[count++] = i;
+			}
+			if (nbr_fresh == TILE_SIZE)
+			{
+				cycles += compute_points(job, re, im, fresh, nbr_fresh);
+				computed += nbr_fresh;
+				nbr_fresh = 0;
+			}
+			if (count == TILE_SIZE)
+			{
+				cycles += continue_points(job, &cont, z_re, z_im, idx, count,
+										  &escaped);
+				resumed += count;
+				count = 0;
+			}
+		}
+	}
+	if (nbr_fresh > 0)
+	{
+		cycles += compute_points(job, re, im, fresh, nbr_fresh);
+		computed += nbr_fresh;
+	}
+	if (count > 0)
+	{
+		cycles += continue_points(job, &cont, z_re, z_im, idx, count, &escaped);
+		resumed += count;
+	}
+	__atomic_add_fetch(&job->cycles, cycles, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&job->computed, computed, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&job->resumed, resumed, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&job->escaped, escaped, __ATOMIC_RELAXED);
+}
+
+/* RETURN THE N THE SHOWN GRID CAN BE CONTINUED FROM, 0 IF IT CAN NOT */
+static int resume_from(void)
 {
-	comp.grid = my_alloc(comp.grid_w * comp.grid_h);
-	comp.grid_computation = my_alloc(comp.grid_w * comp.grid_h);
-	comp.d_re = (comp.range_re_max - comp.range_re_min) / (1. * comp.grid_w);
-	comp.d_im = -(comp.range_im_max - comp.range_im_min) / (1. * comp.grid_h);
-	comp.nbr_chunks = (comp.grid_w * comp.grid_h) /
-					  (comp.chunk_n_re * comp.chunk_n_im);
+	const view_state *v = &comp.shown;
+	// the mixed pass and the perturbation do not keep the orbits
+	const bool same = comp.shown_valid && comp.orbits_ready &&
+					  v->c_re == comp.c_re && v->c_im == comp.c_im &&
+					  v->d_re == comp.d_re && v->d_im == comp.d_im &&
+					  v->center_re.hi == comp.center_re.hi &&
+					  v->center_re.lo == comp.center_re.lo &&
+					  v->center_im.hi == comp.center_im.hi &&
+					  v->center_im.lo == comp.center_im.lo &&
+					  v->precision == comp.precision &&
+					  !(comp.smooth && !comp.smooth_ready);
+	return same && v->n < comp.n ? v->n : 0;
 }
 
-/* CLEANUP ALL STORED DATA AFTER THE COMPUTATION */
-void computation_cleanup(void)
+/* FILL THE CACHE KEY OF THE TILE OF THE JOB */
+static void job_key(const render_job *job, int tile, tile_key *key)
 {
-	if (comp.grid)
+	int x0, y0, x1, y1;
+	tile_bounds(job, tile, &x0, &y0, &x1, &y1); // the cached ones as well
+	make_key(key, comp.precision, x0, y0, x1 - x0, y1 - y0);
+}
+
+/* TAKE THE TILES OF THE VIEW FROM THE CACHE, RETURN HOW MANY WERE THERE */
+static int cache_tiles(const render_job *job, int nbr_tiles)
+{
+	// the deep zoom skips the distance estimation, no samples are kept
+	const bool antialiased = comp.distance && !job->deep;
+	const int pixel = comp.cell + (comp.smooth ? sizeof(float) : 0) +
+					  (antialiased ? 1 + 3 : 0);
+	int hits = 0;
+	memset(comp.cached, 0, nbr_tiles);
+	for (int tile = 0; tile < nbr_tiles && comp.cache_mb; tile++)
 	{
-		free(comp.grid);
-		free(comp.grid_computation);
+		tile_key key;
+		job_key(job, tile, &key);
+		if (cache_get(&key, sizeof(key), comp.tile_buf, key.w * key.h * pixel))
+		{
+			copy_tile(key.x, key.y, key.w, key.h, antialiased, false);
+			for (int y = key.y; y < key.y + key.h && job->z_re; y++)
+			{
+				for (int x = key.x; x < key.x + key.w; x++)
+				{
+					job->z_re[y * job->grid_w + x] = NAN; // no orbit, redone
+				}
+			}
+			comp.cached[tile] = 1;
+			hits++;
+		}
 	}
-	comp.grid = NULL;
+	return hits;
 }
 
-/* RETURN TRUE IF COMPUTING */
-bool is_computing(void)
+/* STORE THE TILES COMPUTED BY THE JOB TO THE CACHE, RETURN HOW MANY */
+static int store_tiles(const render_job *job, int nbr_tiles)
 {
-	return comp.computing;
+	int stored = 0;
+	for (int tile = 0; tile < nbr_tiles && comp.cache_mb; tile++)
+	{
+		if (!comp.cached[tile])
+		{
+			tile_key key;
+			job_key(job, tile, &key);
+			const int len = copy_tile(key.x, key.y, key.w, key.h,
+									  comp.distance && !job->deep, true);
+			cache_put(&key, sizeof(key), comp.tile_buf, len);
+			stored++;
+		}
+	}
+	return stored;
 }
 
-/* RETURN TRUE IF COMPUTATION IS TOTALLY DONE */
-bool is_done(void)
+/* RETURN TRUE FOR Z^2 + C OF JULIA, THE ONLY ONE NUCLEO AND PERTURBATION DO */
+bool is_nucleo_formula()
 {
-	return comp.done;
+	return comp.formula == FORMULA_JULIA && comp.power == 2;
 }
 
-/* CANCEL THE COMPUTATION ABORT */
-void enable_comp(void)
+/*
+ * Pick the cheapest precision which still resolves the pixels. The float is
+ * judged by the pixel size only, not by n, so it is an approximation which
+ * the double ladder never takes. Only julia z^2 gets double-double.
+ */
+static int choose_precision()
 {
-	comp.abort = false;
+	const double m = MAX(MAX(fabs(comp.range_re_min), fabs(comp.range_re_max)),
+						 MAX(fabs(comp.range_im_min), fabs(comp.range_im_max)));
+	const double d = MIN(fabs(comp.d_re), fabs(comp.d_im));
+	if (d < DEEP_ZOOM_LIMIT * m && is_nucleo_formula())
+	{
+		return PRECISION_DD;
+	}
+	if (d < FLOAT_LIMIT * m || comp.ladder == LADDER_DOUBLE ||
+		!kernel_single(comp.formula, comp.power))
+	{
+		return PRECISION_DOUBLE;
+	}
+	return PRECISION_FLOAT;
 }
 
-/* SET THE VALUES WE WANT TO COMPUTE */
-bool set_compute(message *msg)
+/* COPY THE SKIPPED RECTANGLE FROM ITS POINT REFLECTION, RETURN ITS PIXELS */
+static int mirror_grid(const render_job *job, const symmetry *sym)
 {
-	memset(comp.grid_computation, 0,
-		   comp.grid_w * comp.grid_h * sizeof(uint8_t)); // used for p cmd
+	int mirrored = 0;
+	if (!sym) // the skipped rectangle was reused from the panned view
+	{
+		return 0;
+	}
+	for (int y = job->skip_y0; y < job->skip_y1; y++)
+	{
+		const int src = (sym->oy - y) * job->grid_w + sym->ox;
+		const int dst = y * job->grid_w;
+		for (int x = job->skip_x0; x < job->skip_x1; x++)
+		{
+			cell_set(job->grid, job->cell, dst + x,
+					 cell_get(job->grid, job->cell, src - x));
+		}
+		for (int x = job->skip_x0; x < job->skip_x1 && job->smooth; x++)
+		{
+			job->smooth[dst + x] = job->smooth[src - x];
+		}
+		for (int x = job->skip_x0; x < job->skip_x1 && job->samples; x++)
+		{
+			job->samples[dst + x] = job->samples[src - x];
+			memcpy(job->rgb + 3 * (dst + x), job->rgb + 3 * (src - x), 3);
+		}
+		for (int x = job->skip_x0; x < job->skip_x1 && job->z_re; x++)
+		{
+			// z and -z have the same square, the orbits meet after one step
+			job->z_re[dst + x] = job->z_re[src - x];
+			job->z_im[dst + x] = job->z_im[src - x];
+		}
+		mirrored += job->skip_x1 - job->skip_x0;
+	}
+	return mirrored;
+}
 
-	bool ret = !is_computing();
-	if (ret)
+/* FILL THE COORDINATES OF ALL COLUMNS AND ROWS, SAME STEPS AS PIXEL BY PIXEL */
+static void update_coords()
+{
+	if (comp.precision == PRECISION_DD) // offsets from the centre, it lies between the pixels
 	{
-		msg->type = MSG_SET_COMPUTE;
-		msg->data.set_compute.c_re = comp.c_re;
-		msg->data.set_compute.c_im = comp.c_im;
-		msg->data.set_compute.d_re = comp.d_re;
-		msg->data.set_compute.d_im = comp.d_im;
-		msg->data.set_compute.n = comp.n;
-		comp.done = false;
+		for (int width = 0; width < comp.grid_w; width++)
+		{
+			comp.coord_re[width] = (width + 1 - comp.grid_w / 2.) * comp.d_re;
+		}
+		for (int height = 0; height < comp.grid_h; height++)
+		{
+			comp.coord_im[height] = (height + 1 - comp.grid_h / 2.) * comp.d_im;
+		}
+		return;
+	}
+	double px = comp.range_re_min;
+	for (int width = 0; width < comp.grid_w; width++)
+	{
+		px += comp.d_re;
+		comp.coord_re[width] = px;
+	}
+	double py = comp.range_im_max;
+	for (int height = 0; height < comp.grid_h; height++)
+	{
+		py += comp.d_im;
+		comp.coord_im[height] = py;
 	}
-	return ret;
 }
 
-/* SEND THE CURRENT CHUNK POSITION TO NUCLEO TO HOLD THE CALCULATION */
-void compute(message *msg)
+/*
+ * Calculates the fractal using cpu. With the progressive rendering on, the
+ * refresh is called after the coarse passes of 1/16 and 1/4 of the pixels,
+ * the full resolution pass then computes only the pixels still missing.
+ */
+void compute_cpu(void (*refresh)(void))
 {
-	my_assert(msg != NULL, __func__, __LINE__, __FILE__);
-	if (!is_computing()) //first chunk
+	comp.precision = choose_precision();
+	update_coords();
+	const int from = resume_from(); // before the reuse drops the shown view
+	// the other formulas take the pixel as c, their orbits can not go on
+	const bool orbits = comp.deepening && comp.precision != PRECISION_DD &&
+						comp.ladder != LADDER_MIXED &&
+						comp.formula == FORMULA_JULIA;
+	render_job job = {.params = {.c_re = comp.c_re,
+								 .c_im = comp.c_im,
+								 .max_iteration = comp.n,
+								 .periodicity = comp.periodicity,
+								 .single = comp.precision == PRECISION_FLOAT,
+								 .formula = comp.formula,
+								 .power = comp.power},
+					  .re = comp.coord_re,
+					  .im = comp.coord_im,
+					  .grid = comp.grid,
+					  .cell = comp.cell,
+					  .smooth = comp.smooth,
+					  .samples = NULL,
+					  .rgb = comp.rgb,
+					  .d_re = comp.d_re,
+					  .d_im = comp.d_im,
+					  .grid_w = comp.grid_w,
+					  .grid_h = comp.grid_h,
+					  .tiles_x = (comp.grid_w + TILE_SIZE - 1) / TILE_SIZE,
+					  .subdivision = comp.subdivision,
+					  .deep = comp.precision == PRECISION_DD,
+					  .mask = comp.mask,
+					  .skip_x0 = 0,
+					  .skip_y0 = 0,
+					  .skip_x1 = 0,
+					  .skip_y1 = 0,
+					  .step = 1,
+					  .known = 0,
+					  .lattice = NULL,
+					  .cached = NULL,
+					  .z_re = orbits ? comp.orbit_re : NULL,
+					  .z_im = orbits ? comp.orbit_im : NULL,
+					  .resume = from ? from + 1 : 0,
+					  .cycles = 0,
+					  .computed = 0,
+					  .refined = 0,
+					  .supersampled = 0,
+					  .resumed = 0,
+					  .escaped = 0};
+	if (job.deep) // the periodicity check is not used with perturbation
 	{
-		comp.cid = 0;
-		comp.computing = true;
-		comp.cur_x = comp.cur_y = 0;
-		comp.chunk_re = comp.range_re_min; //left
-		comp.chunk_im = comp.range_im_max; //up
-		msg->type = MSG_COMPUTE;
+		job.params.periodicity = false;
+		comp.reference = perturbation_reference(&job.params, comp.center_re,
+												comp.center_im);
 	}
-	else //next chunks
+	symmetry sym;
+	const symmetry *mirror = NULL;
+	const int reuse = reuse_grid(true);
+	if (reuse == 1) // only the strips exposed by the pan are computed
+	{
+		job.skip_x0 = comp.reuse_x0;
+		job.skip_x1 = comp.reuse_x1;
+		job.skip_y0 = comp.reuse_y0;
+		job.skip_y1 = comp.reuse_y1;
+	}
+	else if (find_symmetry(1, &sym)) // the rows below the centre are copied
+	{
+		mirror = &sym;
+		job.skip_x0 = sym.x0;
+		job.skip_x1 = sym.x1 + 1;
+		job.skip_y0 = sym.oy / 2 + 1;
+		job.skip_y1 = sym.y1 + 1;
+	}
+	job.lattice = reuse > 1 ? comp.lattice : NULL; // zoomed in, kept between
+	if (job.z_re && reuse && !comp.orbits_ready) // the kept pixels have none
 	{
-		comp.cid += 1;
-		if (comp.cid < comp.nbr_chunks)
+		for (int i = 0; i < comp.grid_w * comp.grid_h; i++)
 		{
-			comp.cur_x += comp.chunk_n_re;
-			comp.chunk_re += comp.chunk_n_re * comp.d_re;
-			if (comp.cur_x >= comp.grid_w)
-			{
-				comp.cur_x = 0;
-				comp.chunk_re = comp.range_re_min;
-				comp.chunk_im += comp.chunk_n_im * comp.d_im;
-				comp.cur_y += comp.chunk_n_im;
-			}
-			msg->type = MSG_COMPUTE;
+			job.z_re[i] = NAN;
 		}
 	}
-	if (comp.computing && msg->type == MSG_COMPUTE) //calculation saved to msg
+	const int tiles_y = (comp.grid_h + TILE_SIZE - 1) / TILE_SIZE;
+	comp.cache_hits = cache_tiles(&job, job.tiles_x * tiles_y);
+	job.cached = comp.cache_hits > 0 ? comp.cached : NULL;
+	comp.antialiased = false; // the samples are of the previous picture
+	for (job.step = PROGRESSIVE_STEP;
+		 comp.progressive && refresh && !job.resume && job.step > 1;
+		 job.step /= 2)
 	{
-		msg->data.compute.cid = comp.cid;
-		msg->data.compute.re = comp.chunk_re;
-		msg->data.compute.im = comp.chunk_im;
-		msg->data.compute.n_re = comp.chunk_n_re;
-		msg->data.compute.n_im = comp.chunk_n_im;
+		pool_run(job.tiles_x * tiles_y, preview_tile, &job);
+		mirror_grid(&job, mirror);
+		comp.smooth_ready = comp.smooth != NULL;
+		damage_grid();
+		refresh();
+		job.known = job.step;
+	}
+	pool_run(job.tiles_x * tiles_y, job.resume ? resume_tile : render_tile,
+			 &job);
+	comp.mirrored = mirror_grid(&job, mirror);
+	if (job.params.single && comp.ladder == LADDER_MIXED)
+	{
+		job.params.single = false; // band edges once more in double
+		pool_run(job.tiles_x * tiles_y, mark_tile, &job);
+		pool_run(job.tiles_x * tiles_y, refine_tile, &job);
+		mirror_grid(&job, mirror);
+	}
+	if (comp.distance && !job.deep) // the samples need absolute coordinates
+	{
+		job.samples = comp.samples;
+		pool_run(job.tiles_x * tiles_y, estimate_tile, &job);
+		mirror_grid(&job, mirror);
 	}
+	comp.cycles = job.deep ? 0 : job.cycles;
+	comp.rebased = job.deep ? job.cycles : 0;
+	comp.computed = job.computed;
+	comp.refined = job.refined;
+	comp.smooth_ready = comp.smooth != NULL;
+	comp.antialiased = job.samples != NULL;
+	comp.supersampled = job.supersampled;
+	comp.orbits_ready = job.z_re != NULL;
+	comp.resumed = job.resumed;
+	comp.escaped = job.escaped;
+	comp.resumed_from = from;
+	comp.cache_misses = store_tiles(&job, job.tiles_x * tiles_y);
+	remember_view(comp.precision);
+	damage_grid();
 }
 
-/* RETURN TRUE IF THE COMPUTATION IS ABORTED */
-bool is_abort(void)
+/* RETURN THE TILES OR CHUNKS TAKEN FROM THE CACHE BY THE LAST COMPUTATION */
+int cached_tiles()
 {
-	return comp.abort;
+	return comp.cache_hits;
 }
 
-/* UPDATE STRUCT WITH ACTUAL VALUES AND OCASIONALLY STOPS THE CALCULATION */
-void update_data(const msg_compute_data *compute_data)
+/* RETURN THE TILES OR CHUNKS THE LAST COMPUTATION HAD TO COMPUTE */
+int missed_tiles()
 {
-	my_assert(compute_data != NULL, __func__, __LINE__, __FILE__);
-	if (compute_data->cid == comp.cid)
-	{
-		const int idx = comp.cur_x + compute_data->i_re +
-						(comp.cur_y + compute_data->i_im) * comp.grid_w;
-		if (idx > 0 && idx < comp.grid_h * comp.grid_w)
-		{
-			comp.grid[idx] = compute_data->iter;
-			comp.grid_computation[idx] = compute_data->iter;
-		}
-		if ((comp.cid + 1) >= comp.nbr_chunks &&
-			(compute_data->i_re + 1) == comp.chunk_n_re &&
-			(compute_data->i_im + 1) == comp.chunk_n_im)
-		{
-			comp.done = true;
-			comp.computing = false;
-		}
-	}
-	else
+	return comp.cache_misses;
+}
+
+/* RETURN THE PIXELS CONTINUED FROM THEIR ORBITS BY THE LAST CPU RUN */
+int resumed_pixels()
+{
+	return comp.resumed;
+}
+
+/* RETURN HOW MANY OF THE CONTINUED PIXELS ESCAPED */
+int escaped_pixels()
+{
+	return comp.escaped;
+}
+
+/* RETURN THE NUMBER OF ITERATIONS THE PIXELS WERE CONTINUED FROM */
+int resumed_iterations()
+{
+	return comp.resumed_from;
+}
+
+/* RETURN THE NUMBER OF ITERATIONS */
+int max_iterations()
+{
+	return comp.n;
+}
+
+/* COPY THE GRID TO WIDER CELLS */
+static void *widen_grid(void *grid, int cell)
+{
+	void *wide = my_alloc(comp.grid_w * comp.grid_h * cell);
+	for (int i = 0; i < comp.grid_w * comp.grid_h; i++)
 	{
-		ERROR("Recieved chunk with unexpected chunkid\n");
+		cell_set(wide, cell, i, cell_get(grid, comp.cell, i));
 	}
+	free(grid);
+	return wide;
 }
 
-/* UPDATES THE RGB IMAGE VALUES */
-void update_image(int w, int h, unsigned char *img)
+/*
+ * Double the number of iterations, the grids get wider cells if n + 1 does
+ * not fit anymore. The shown grid stays valid, so the next cpu run continues
+ * its interior pixels if their orbits were kept. False at the limit.
+ */
+bool deepen_iterations()
 {
-	my_assert(img && comp.grid && w == comp.grid_w && h == comp.grid_h,
-			  __func__, __LINE__, __FILE__);
-	for (int i = 0; i < w * h; ++i)
+	if (comp.n >= MAX_ITERATION)
 	{
-		const double t = 1. * comp.grid[i] / (comp.n + 1.0);
-		*(img++) = 9 * (1 - t) * t * t * t * 255;				//R
-		*(img++) = 15 * (1 - t) * (1 - t) * t * t * 255;		//G
-		*(img++) = 8.5 * (1 - t) * (1 - t) * (1 - t) * t * 255; //B
+		return false;
 	}
+	comp.n = MIN(2 * comp.n, MAX_ITERATION);
+	const int cell = cell_width(comp.n);
+	if (cell > comp.cell)
+	{
+		comp.grid = widen_grid(comp.grid, cell);
+		comp.grid_computation = widen_grid(comp.grid_computation, cell);
+		comp.cell = cell;
+		free(comp.tile_buf);
+		comp.tile_buf = my_alloc(tile_buf_size());
+	}
+	damage_grid(); // the colors follow n
+	return true;
 }
 
-/* SET THE COMPUTATION ABORT ON TRUE */
-void abort_comp(void)
+/* RETURN THE PIXELS KEPT FROM THE PANNED OR ZOOMED VIEW BY THE LAST RUN */
+int reused_pixels()
 {
-	memset(comp.grid_computation, 0,
-		   comp.grid_w * comp.grid_h * sizeof(uint8_t)); // used for p cmd
-	comp.computing = false;
-	comp.abort = true;
+	return comp.reused;
 }
 
-/* SAVE PICTURE RESOLUTION TO VARIABLES  */
-void get_grid_size(int *width, int *height)
+/* RETURN TRUE IF THE DISTANCE ESTIMATION SUPERSAMPLING IS ENABLED */
+bool is_distance()
 {
-	*width = comp.grid_w;
-	*height = comp.grid_h;
+	return comp.distance;
 }
 
-/* RETURNS PICTURE WIDTH */
-int grid_width()
+/* RETURN TRUE IF THE CPU RENDERING SHOWS THE COARSE PASSES FIRST */
+bool is_progressive()
 {
-	return comp.grid_w;
+	return comp.progressive;
 }
 
-/* RETURN PICTURE HEIGHT */
-int grid_height()
+/* RETURN THE PIXELS SUPERSAMPLED ON THE BOUNDARY IN THE LAST CPU RUN */
+int supersampled_pixels()
 {
-	return comp.grid_h;
+	return comp.supersampled;
 }
 
-/* RETURN THE NUMBER OF CHUNKS */
-int number_of_chunks()
+/* RETURN THE NAME OF THE PRECISION USED IN THE LAST CPU COMPUTATION */
+const char *precision_name()
 {
-	return comp.nbr_chunks;
+	return precision_names[comp.precision];
 }
 
-/* RETURN THE POSITION ON REAL AXES */
-int cursor_width()
+/* RETURN THE PIXELS RECOMPUTED IN DOUBLE BY THE LAST MIXED PASS */
+int refined_pixels()
 {
-	return comp.cur_x;
+	return comp.refined;
 }
 
-/* RETURN THE POSITION ON IMAGINARY AXES */
-int cursor_height()
+/* RETURN TRUE IF THE LAST CPU COMPUTATION USED THE PERTURBATION */
+bool is_deep_zoom()
 {
-	return comp.cur_y;
+	return comp.precision == PRECISION_DD;
 }
 
-/* RETURN TRUE IF THE USER INPUT IS DIVISIBLE - MODULO IS ZERO */
-bool correct_input()
+/* RETURN THE LENGTH OF THE REFERENCE ORBIT OF THE LAST DEEP ZOOM */
+int reference_length()
 {
-	return (comp.grid_w % comp.chunk_n_re == 0 &&
-			comp.grid_h % comp.chunk_n_im == 0);
+	return comp.reference;
 }
 
-/* COMPUTE THE NUMBER OF ITERATIONS FOR PIXEL PX PY */
-uint8_t compute_iter(double cx, double cy, double px,
-					 double py, uint8_t max_iteration)
+/* RETURN THE PIXELS REBASED TO THE CRITICAL ORBIT IN THE LAST DEEP ZOOM */
+int rebased_pixels()
 {
-	uint8_t ret = 0;
-	while (ret <= max_iteration && sqrt(px * px + py * py) < 2)
-	{
-		double temp = px * px - py * py + cx;
-		py = 2 * px * py + cy;
-		px = temp;
-		ret++;
-	}
-	return ret;
+	return comp.rebased;
 }
 
-/* CALCULATES THE FRACTAL USING CPU */
-void compute_cpu()
+/* SET THE RANGES AROUND THE CENTRE BY THE PIXEL SIZE */
+static void update_ranges(void)
 {
-	int i = 0;
-	double py = comp.range_im_max;
-	for (int height = 0; height < comp.grid_h; height++)
+	const double half_re = comp.d_re * comp.grid_w / 2;
+	const double half_im = -comp.d_im * comp.grid_h / 2;
+	comp.range_re_min = comp.center_re.hi - half_re;
+	comp.range_re_max = comp.center_re.hi + half_re;
+	comp.range_im_min = comp.center_im.hi - half_im;
+	comp.range_im_max = comp.center_im.hi + half_im;
+}
+
+/* ZOOM AROUND THE VIEW CENTRE, FACTOR ABOVE ONE ZOOMS IN, FALSE AT THE LIMIT */
+bool zoom_view(double factor)
+{
+	const double m = MAX(fabs(comp.center_re.hi), fabs(comp.center_im.hi));
+	// only z^2 + c of julia goes below the double by perturbation
+	const double limit = is_nucleo_formula() ? ZOOM_LIMIT : DEEP_ZOOM_LIMIT;
+	if (MIN(fabs(comp.d_re), fabs(comp.d_im)) / factor < limit * m ||
+		MAX(fabs(comp.d_re), fabs(comp.d_im)) / factor > 1)
 	{
-		double px = comp.range_re_min;
-		py += comp.d_im;
-		for (int width = 0; width < comp.grid_w; width++)
-		{
-			px += comp.d_re;
-			comp.grid[i++] = compute_iter(comp.c_re, comp.c_im, px, py, comp.n);
-		}
+		return false;
 	}
+	comp.d_re /= factor;
+	comp.d_im /= factor;
+	update_ranges();
+	return true;
+}
+
+/*
+ * Move the view by whole pixels, pixel (x, y) shows what (x + dx, y + dy)
+ * showed. The next computation keeps the overlap and computes the rest.
+ */
+void pan_view(int dx, int dy)
+{
+	comp.center_re = dd_add_d(comp.center_re, dx * comp.d_re);
+	comp.center_im = dd_add_d(comp.center_im, dy * comp.d_im);
+	update_ranges();
+}
+
+/* RETURN THE SIZE OF ONE PIXEL IN REAL AXIS */
+double pixel_size()
+{
+	return comp.d_re;
+}
+
+/* RETURN THE NUMBER OF PIXELS MIRRORED IN THE LAST CPU COMPUTATION */
+int mirrored_pixels()
+{
+	return comp.mirrored;
+}
+
+/* RETURN TRUE IF THE RECTANGLE SUBDIVISION IS ENABLED */
+bool is_subdivision()
+{
+	return comp.subdivision;
+}
+
+/* RETURN THE NUMBER OF PIXELS ITERATED IN THE LAST CPU COMPUTATION */
+int computed_pixels()
+{
+	return comp.computed;
+}
+
+/* RETURN TRUE IF THE PERIODICITY CHECK IS ENABLED */
+bool is_periodicity()
+{
+	return comp.periodicity;
+}
+
+/* RETURN THE PIXELS STOPPED BY THE PERIODICITY CHECK IN THE LAST CPU RUN */
+int periodicity_exits()
+{
+	return comp.cycles;
 }
 
 /* INCREASE THE PARAMETER DURING COMPUTATION */
@@ -308,34 +2521,143 @@ void decrease_parameter(msg_set_compute *set_compute)
 	set_compute->c_im = comp.c_im;
 }
 
-/* DECREASE THE CONSTANT TO END ANIMATION AT DEFAULT VALUE FROM SETTINGS */
-void set_up_animation(msg_set_compute *set_compute, int animation_frames)
+/* SET THE COORDINATES OF THE VIEW THE ANIMATION FRAMES ARE RENDERED IN */
+void prepare_frames()
+{
+	comp.precision = choose_precision();
+	update_coords();
+	update_colors(); // only read by the workers during the animation
+}
+
+/*
+ * Render the frame of the animation ending at the current constant into the
+ * rgb image, frames are independent so the workers render several at once.
+ * Only the view and the constant are read, the grids are not touched. The
+ * deep zoom is iterated in double, the frames are a preview.
+ */
+void render_frame(int frame, int frames, int w, int h, unsigned char *img)
+{
+	my_assert(w == comp.grid_w && h == comp.grid_h, __func__, __LINE__,
+			  __FILE__);
+	const int back = frames - 1 - frame; // steps before the current constant
+	const kernel_params params = {.c_re = comp.c_re - back * ANIMATION_STEP,
+								  .c_im = comp.c_im - back * ANIMATION_STEP,
+								  .max_iteration = comp.n,
+								  .periodicity = comp.periodicity,
+								  .single = comp.precision == PRECISION_FLOAT,
+								  .formula = comp.formula,
+								  .power = comp.power};
+	const bool dd = comp.precision == PRECISION_DD;
+	double *re = my_alloc(w * sizeof(double));
+	uint32_t *out = my_alloc(w * sizeof(uint32_t));
+	float *mag = comp.smoothing ? my_alloc(w * sizeof(float)) : NULL;
+	for (int x = 0; x < w; x++) // the offsets of the deep zoom made absolute
+	{
+		re[x] = dd ? comp.center_re.hi + comp.coord_re[x] : comp.coord_re[x];
+	}
+	for (int y = 0; y < h; y++, img += 3 * w)
+	{
+		const double im = dd ? comp.center_im.hi + comp.coord_im[y]
+							 : comp.coord_im[y];
+		kernel_row(&params, re, im, w, out, mag, NULL, NULL);
+		for (int x = 0; x < w && mag; x++)
+		{
+			palette_color(smooth_value(out[x], mag[x], &params), comp.n,
+						  img + 3 * x);
+		}
+		if (!mag)
+		{
+			palette_map(comp.colors, comp.n, out, sizeof(uint32_t), w, img);
+		}
+	}
+	free(re);
+	free(out);
+	free(mag);
+}
+
+/* ROWS OF A VIEW RENDERED APART FROM THE GRID */
+typedef struct
+{
+	kernel_params params;
+	const double *re;
+	double im_max;
+	double d_im;
+	int w;
+	uint32_t *out;
+} view_job;
+
+/* ITERATE ONE ROW OF THE VIEW */
+static void view_row(int row, void *arg)
+{
+	const view_job *job = (const view_job *)arg;
+	kernel_row(&job->params, job->re, job->im_max + (row + 1) * job->d_im,
+			   job->w, job->out + row * job->w, NULL, NULL, NULL);
+}
+
+/*
+ * Iterate the view into out, one value per pixel placed as in the grid. The
+ * grid and the settings are not touched, so any thread may render its own
+ * views at once, the rows are shared out to the pool. Deeper views than the
+ * double holds are not refined by perturbation.
+ */
+void render_view(const view_params *v, uint32_t *out)
 {
-	comp.c_re -= animation_frames * 0.005;
-	comp.c_im -= animation_frames * 0.005;
+	const double d_re = (v->re_max - v->re_min) / v->w;
+	const double d_im = -(v->im_max - v->im_min) / v->h;
+	const double m = MAX(MAX(fabs(v->re_min), fabs(v->re_max)),
+						 MAX(fabs(v->im_min), fabs(v->im_max)));
+	double *re = my_alloc(v->w * sizeof(double));
+	for (int x = 0; x < v->w; x++)
+	{
+		re[x] = v->re_min + (x + 1) * d_re;
+	}
+	view_job job = {.params = {.c_re = v->c_re,
+							   .c_im = v->c_im,
+							   .max_iteration = MIN(v->n, MAX_ITERATION),
+							   .periodicity = comp.periodicity,
+							   .single = MIN(d_re, -d_im) >= FLOAT_LIMIT * m &&
+										 comp.ladder != LADDER_DOUBLE,
+							   .formula = comp.formula,
+							   .power = comp.power},
+					.re = re,
+					.im_max = v->im_max,
+					.d_im = d_im,
+					.w = v->w,
+					.out = out};
+	pool_run(v->h, view_row, &job);
+	free(re);
 }
 
-/* DECREASE LOCAL VALUE OF CONSTANT TO ANIAMTE THE FRACTAL */
-void animate()
+/* COLOR THE ITERATIONS OF A VIEW WITH THE PALETTE OF THE GRID */
+void color_view(const uint32_t *values, int count, int n, unsigned char *rgb)
 {
-	comp.c_re += 0.005;
-	comp.c_im += 0.005;
-	usleep(150); //it is too quick when the resolution is small
+	// a table of its own, the views of other threads may have other n
+	uint32_t *table = n + 2 <= count ? palette_table(n) : NULL;
+	palette_map(table, n, values, sizeof(uint32_t), count, rgb);
+	free(table);
 }
 
 /* CLEAR THE CURRENT GRID COMPUTATION */
 void clear_grid()
 {
-	memset(comp.grid, 0, comp.grid_w * comp.grid_h * sizeof(uint8_t));
+	memset(comp.grid, 0, comp.grid_w * comp.grid_h * comp.cell);
+	damage_grid();
+	comp.smooth_ready = false;
+	comp.antialiased = false;
+	comp.orbits_ready = false;
+	comp.shown_valid = false;
 }
 
 /* COPY THE CURRENT CALCULATION TO DEFAULT GRID WHICH IS SHOWN IN SDL */
 void update_grid()
 {
-	for (int i = 0; i < comp.grid_w * comp.grid_h; i++)
-	{
-		comp.grid[i] = comp.grid_computation[i];
-	}
+	memcpy(comp.grid, comp.grid_computation,
+		   comp.grid_w * comp.grid_h * comp.cell);
+	damage_grid();
+	comp.smooth_ready = false;
+	comp.antialiased = false;
+	comp.orbits_ready = false;
+	comp.shown_valid = false;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -343,6 +2665,7 @@ void update_grid()
 ///////////////////////////////////////////////////////////////////////////////
 void change_settings(char c)
 {
+	damage_grid(); // the colors may follow the new settings
 	switch (c)
 	{
 	case 65: // uparrow
@@ -375,11 +2698,18 @@ void change_settings(char c)
 		break;
 	case '+':
 		comp.n++;
+		comp.n = MIN(comp.n, MAX_ITERATION);
 		break;
 	case '-':
 		comp.n--;
 		comp.n = MAX(comp.n, 1);
 		break;
+	case '*':
+		comp.n = MIN(2 * comp.n, MAX_ITERATION);
+		break;
+	case '/':
+		comp.n = MAX(comp.n / 2, 1);
+		break;
 	case 'k':
 		comp.c_re -= 0.1;
 		break;
@@ -420,6 +2750,44 @@ void change_settings(char c)
 	case 't':
 		comp.range_im_max += 0.1;
 		break;
+	case 'p':
+		comp.periodicity = !comp.periodicity;
+		break;
+	case 'b':
+		comp.subdivision = !comp.subdivision;
+		break;
+	case 'e':
+		comp.ladder = (comp.ladder + 1) % LADDER_NBR;
+		break;
+	case 'v':
+		comp.smoothing = !comp.smoothing;
+		break;
+	case 'd':
+		comp.distance = !comp.distance;
+		break;
+	case 'r':
+		comp.progressive = !comp.progressive;
+		break;
+	case 'w':
+		comp.deepening = !comp.deepening;
+		break;
+	case 'm':
+		comp.formula = (comp.formula + 1) % FORMULA_NBR;
+		break;
+	case 'z':
+		comp.power = comp.power % MAX_POWER + 1;
+		comp.power = MAX(comp.power, MIN_POWER);
+		break;
+	case 'c':
+		for (int i = 0; i < CACHE_BUDGETS; i++) // the next one after it
+		{
+			if (cache_budgets[i] == comp.cache_mb)
+			{
+				comp.cache_mb = cache_budgets[(i + 1) % CACHE_BUDGETS];
+				break;
+			}
+		}
+		break;
 	case 'q':
 		call_termios(1); // cooked mode - restore terminal settings
 		exit(0);
@@ -433,7 +2801,7 @@ void change_settings(char c)
 void print_changed_settings()
 {
 
-	printf("\033[14A");
+	printf("\033[23A");
 	printf(
 		"║ ACTIVE SETTINGS:                                               ║\n"
 		"║ resolution:                         %-4d x %-4d                ║\n",
@@ -457,11 +2825,20 @@ void print_changed_settings()
 	}
 
 	printf(
-		"║ number of iterations:               %-3d                        ║\n"
+		"║ number of iterations:               %-10d                 ║\n"
 		"║ parameter real part:               %+-3.1f                        ║\n"
 		"║ parameter imaginary  part:         %+-3.1f i                      ║\n"
 		"║ range of real axes:                %+-3.1f -> %+-3.1f                ║\n"
 		"║ range of imaginary axes:           %+-3.1f -> %+-3.1f                ║\n"
+		"║ periodicity check:                  %-3s                        ║\n"
+		"║ rectangle subdivision:              %-3s                        ║\n"
+		"║ precision ladder:                   %-6s                     ║\n"
+		"║ smooth coloring:                    %-3s                        ║\n"
+		"║ distance estimation:                %-3s                        ║\n"
+		"║ progressive rendering:              %-3s                        ║\n"
+		"║ tile cache:                         %-3d MB                     ║\n"
+		"║ iteration deepening:                %-3s                        ║\n"
+		"║ formula:                            %-12s z^%d           ║\n"
 		"║ download image:                     yes                        ║\n"
 		"║                                                                ║\n"
 		"║                                                                ║\n"
@@ -473,5 +2850,15 @@ void print_changed_settings()
 		comp.range_re_min,
 		comp.range_re_max,
 		comp.range_im_min,
-		comp.range_im_max);
+		comp.range_im_max,
+		comp.periodicity ? "yes" : "no",
+		comp.subdivision ? "yes" : "no",
+		ladder_names[comp.ladder],
+		comp.smoothing ? "yes" : "no",
+		comp.distance ? "yes" : "no",
+		comp.progressive ? "yes" : "no",
+		comp.cache_mb,
+		comp.deepening ? "yes" : "no",
+		formula_names[comp.formula],
+		comp.power);
 }
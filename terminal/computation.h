@@ -7,6 +7,32 @@
 
 #include <stdbool.h>
 #include "message.h"
+#include "palette.h"
+
+/* PARAMETERS OF A WHOLE VIEW, USED BY THE HEADLESS BATCH MODE */
+typedef struct
+{
+	double c_re;
+	double c_im;
+	double re_min;
+	double re_max;
+	double im_min;
+	double im_max;
+	int n;
+	int w;
+	int h;
+} view_params;
+
+#define DAMAGE_RECTS 16 // damaged rectangles kept apart, more are merged
+
+/* RECTANGLE OF THE GRID IN PIXELS */
+typedef struct
+{
+	int x;
+	int y;
+	int w;
+	int h;
+} grid_rect;
 
 void abort_comp(void);
 void enable_comp(void);
@@ -14,6 +40,8 @@ bool is_computing(void);
 bool is_done(void);
 void computation_init(void);
 void computation_cleanup(void);
+void get_view(view_params *v);
+void set_view(const view_params *v);
 bool set_compute(message *msg);
 void compute(message *msg);
 bool is_abort(void);
@@ -23,17 +51,49 @@ int grid_height();
 int number_of_chunks();
 void update_data(const msg_compute_data *compute_data);
 void update_image(int w, int h, unsigned char *img);
+int take_damage(grid_rect *rects);
+void update_pixels(const grid_rect *rect, uint32_t *pixels, int pitch,
+				   pixel_format format);
 int cursor_height();
 int cursor_width();
-uint8_t compute_iter(double cx, double cy, double px, double py, uint8_t max_iteration);
-void compute_cpu();
+uint32_t compute_iter(double cx, double cy, double px, double py, uint32_t max_iteration);
+uint32_t compute_distance(double cx, double cy, double px, double py,
+						  uint32_t max_iteration, double *distance, float *mag);
+void compute_cpu(void (*refresh)(void));
+bool is_periodicity();
+bool is_nucleo_formula();
+int periodicity_exits();
+bool is_subdivision();
+int computed_pixels();
+int mirrored_pixels();
+bool is_distance();
+bool is_progressive();
+int supersampled_pixels();
+bool is_deep_zoom();
+int reference_length();
+int rebased_pixels();
+bool zoom_view(double factor);
+void pan_view(int dx, int dy);
+int reused_pixels();
+int cached_tiles();
+int missed_tiles();
+int resumed_pixels();
+int escaped_pixels();
+int resumed_iterations();
+int max_iterations();
+bool deepen_iterations();
+const char *precision_name();
+int refined_pixels();
+double pixel_size();
 void decrease_parameter(msg_set_compute *set_compute);
 void increase_parameter(msg_set_compute *set_compute);
 void change_settings(char c);
 void print_changed_settings();
 bool correct_input();
-void set_up_animation(msg_set_compute *set_compute, int animation_frames);
-void animate();
+void prepare_frames();
+void render_frame(int frame, int frames, int w, int h, unsigned char *img);
+void render_view(const view_params *v, uint32_t *out);
+void color_view(const uint32_t *values, int count, int n, unsigned char *rgb);
 void clear_grid();
 void update_grid();
 
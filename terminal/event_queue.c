@@ -84,6 +84,19 @@ void queue_push(event ev)
    pthread_mutex_unlock(&(q.mtx));
 }
 
+/* RETURN TRUE IF AN EVENT OF THE TYPE IS WAITING IN THE QUEUE */
+bool queue_has(event_type type)
+{
+   bool ret = false;
+   pthread_mutex_lock(&(q.mtx));
+   for (int i = q.out; i != q.in && !ret; i = (i + 1) % QUEUE_CAPACITY)
+   {
+      ret = q.queue[i].type == type;
+   }
+   pthread_mutex_unlock(&(q.mtx));
+   return ret;
+}
+
 /* SET THE QUIT ON TRUE IN CRITICAL SECTION */
 void set_quit()
 {
@@ -31,7 +31,13 @@ typedef enum
    EV_DECREASE,    // decrease the parameter c
    EV_ANIMATE,     // animate fractal to default values
    EV_CLEAR_GRID,  // inicialize the grid to zeros
-   EV_UPDATE_GRID  // copy the atual computation to default grid
+   EV_UPDATE_GRID, // copy the atual computation to default grid
+   EV_ZOOM_IN,     // halve the view around its centre
+   EV_ZOOM_OUT,    // double the view around its centre
+   EV_PAN,         // move the view by whole pixels, param is the arrow
+   EV_DEEPEN,      // double the iterations, param 1 if idle deepening sent it
+   EV_IDLE_DEEPEN, // switch the deepening while idle on or off
+   EV_ANIMATION_DONE // the presenter has shown the last frame, param is the run
 } event_type;
 
 /* KEYBOARD MESSAGE */
@@ -62,6 +68,7 @@ void queue_init(void);
 void queue_cleanup(void);
 event queue_pop(void);
 void queue_push(event ev);
+bool queue_has(event_type type);
 bool is_quit();
 void set_quit();
 
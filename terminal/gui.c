@@ -2,52 +2,298 @@
 //  CREATES THE GRAPHICAL OUTPUT
 ///////////////////////////////////////////////////////////////////////////////
 
+/*
+ * The window belongs to the display thread, no other thread touches SDL.
+ * The boss colors the changed rectangles of the grid into the back frame,
+ * 32 bit pixels in the format of the texture, without holding the shared
+ * lock. Under the lock it only swaps the back and the front frame and adds
+ * the rectangles to the pending ones. The new back frame misses them, they
+ * are colored into it again with the next changes. The display thread fills
+ * the pending rectangles of the texture straight from the front frame under
+ * the lock and presents it after the lock is released.
+ */
+
 #include "gui.h"
 #include "xwin_sdl.h"
 #include "my_functions.h"
 #include "computation.h"
+#include "writer.h"
 #include <SDL.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
 #include "event_queue.h"
 #define SDL_EVENT_POLL_WAIT_MS 10
+#define DISPLAY_HZ 60	  // refresh rate of the window without FRACTAL_REFRESH
+#define DISPLAY_MAX_HZ 240 // the highest one FRACTAL_REFRESH may ask for
 
-/* CONTAINS WIDTH, HEIGHT AND POINTER TO DATA WITH IMAGE */
+/* CONTAINS WIDTH, HEIGHT AND THE FRAMES SHARED WITH THE DISPLAY THREAD */
 static struct
 {
 	int w;
 	int h;
-	unsigned char *img;
-} gui = {.img = NULL};
+	double period;		 // milliseconds between two refreshes of the window
+	double published;	 // last refresh of the boss, boss thread only
+	pthread_t display;
+	pthread_mutex_t draw; // the fields below up to mtx, boss and presenter
+	bool stale;			  // the front frame holds something else than the grid
+	uint32_t *back;		  // the frame the next rectangles are colored into
+	grid_rect missing[DAMAGE_RECTS]; // of the back frame, in the front one
+	int missing_count;
+	pthread_mutex_t mtx; // the fields below
+	pthread_cond_t cond;
+	bool open;
+	bool closing;
+	pixel_format format;			 // of the texture the grid is colored into
+	uint32_t *front;				 // the last published frame, never written
+	grid_rect pending[DAMAGE_RECTS]; // of the front frame not yet shown
+	int pending_count;
+} gui = {.open = false,
+		 .draw = PTHREAD_MUTEX_INITIALIZER,
+		 .mtx = PTHREAD_MUTEX_INITIALIZER,
+		 .cond = PTHREAD_COND_INITIALIZER};
+
+/* GROW THE RECTANGLE A TO THE BOUNDING BOX OF BOTH */
+static void rect_union(grid_rect *a, const grid_rect *b)
+{
+	const int x1 = MAX(a->x + a->w, b->x + b->w);
+	const int y1 = MAX(a->y + a->h, b->y + b->h);
+	a->x = MIN(a->x, b->x);
+	a->y = MIN(a->y, b->y);
+	a->w = x1 - a->x;
+	a->h = y1 - a->y;
+}
+
+/*
+ * Add the rectangle to the list of at most DAMAGE_RECTS. A touching one
+ * grows to hold it, the others are kept apart and uploaded on their own
+ * until all places are taken and they are merged.
+ */
+static void add_rect(grid_rect *list, int *count, const grid_rect *r)
+{
+	for (int i = *count - 1; i >= 0; i--)
+	{
+		grid_rect *p = &list[i];
+		if (p->x <= r->x + r->w && r->x <= p->x + p->w &&
+			p->y <= r->y + r->h && r->y <= p->y + p->h)
+		{
+			rect_union(p, r);
+			return;
+		}
+	}
+	if (*count == DAMAGE_RECTS)
+	{
+		for (int i = 1; i < *count; i++)
+		{
+			rect_union(&list[0], &list[i]);
+		}
+		*count = 1;
+		rect_union(&list[0], r);
+		return;
+	}
+	list[(*count)++] = *r;
+}
+
+/*
+ * Publish the rectangles just drawn into the back frame, under the draw
+ * lock. The frames are swapped, the new back one misses the rectangles.
+ */
+static void publish(const grid_rect *rects, int count)
+{
+	pthread_mutex_lock(&gui.mtx);
+	uint32_t *front = gui.back;
+	gui.back = gui.front;
+	gui.front = front;
+	for (int i = 0; i < count; i++)
+	{
+		add_rect(gui.pending, &gui.pending_count, &rects[i]);
+	}
+	pthread_cond_signal(&gui.cond);
+	pthread_mutex_unlock(&gui.mtx);
+	memcpy(gui.missing, rects, count * sizeof(grid_rect));
+	gui.missing_count = count;
+}
+
+/* WAIT ON THE CONDITION AT MOST THE MILLISECONDS, UNDER THE LOCK */
+static void wait_ms(double ms)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	const long long ns = ts.tv_nsec + (long long)(ms * 1e6);
+	ts.tv_sec += ns / 1000000000LL;
+	ts.tv_nsec = ns % 1000000000LL;
+	while (pthread_cond_timedwait(&gui.cond, &gui.mtx, &ts) == EINTR)
+		;
+}
+
+/* OPEN THE WINDOW, THEN SHOW THE PENDING PARTS OF THE FRAME AT THE RATE */
+void *win_thread(void *arg)
+{
+	(void)arg;
+	my_assert(xwin_init(gui.w, gui.h) == 0, __func__, __LINE__, __FILE__);
+	pthread_mutex_lock(&gui.mtx);
+	gui.format = xwin_format();
+	gui.open = true;
+	pthread_cond_broadcast(&gui.cond);
+	double shown = 0;
+	while (!gui.closing)
+	{
+		const double left = shown + gui.period - get_time_ms();
+		if (gui.pending_count == 0 || left > 0) // events are polled meanwhile
+		{
+			wait_ms(gui.pending_count == 0 ? SDL_EVENT_POLL_WAIT_MS
+										   : MIN(left, SDL_EVENT_POLL_WAIT_MS));
+			pthread_mutex_unlock(&gui.mtx);
+			xwin_poll_events();
+			pthread_mutex_lock(&gui.mtx);
+			continue;
+		}
+		for (int i = 0; i < gui.pending_count; i++) // only they are uploaded
+		{
+			const grid_rect *r = &gui.pending[i];
+			int pitch;
+			char *pixels = (char *)xwin_lock(r->x, r->y, r->w, r->h, &pitch);
+			for (int y = r->y; y < r->y + r->h; y++, pixels += pitch)
+			{
+				memcpy(pixels, gui.front + y * gui.w + r->x,
+					   r->w * sizeof(uint32_t));
+			}
+			xwin_unlock();
+		}
+		gui.pending_count = 0;
+		pthread_mutex_unlock(&gui.mtx);
+		xwin_present(); // waits for the vertical sync
+		xwin_poll_events();
+		shown = get_time_ms();
+		pthread_mutex_lock(&gui.mtx);
+	}
+	pthread_mutex_unlock(&gui.mtx);
+	xwin_close();
+	return NULL;
+}
+
+/* ALLOCATE A BLACK FRAME OF THE WINDOW SIZE */
+static uint32_t *new_frame(void)
+{
+	uint32_t *frame = my_alloc(gui.w * gui.h * sizeof(uint32_t));
+	memset(frame, 0, gui.w * gui.h * sizeof(uint32_t));
+	return frame;
+}
 
-/* INITIALIZE THE WINDOW WHERE THE FRACTAL WILL BE LOADED */
+/* START THE DISPLAY THREAD AND WAIT FOR ITS WINDOW */
 void gui_init(void)
 {
 	get_grid_size(&gui.w, &gui.h);
-	gui.img = my_alloc(gui.w * gui.h * 3);
-	my_assert(xwin_init(gui.w, gui.h) == 0, __func__, __LINE__, __FILE__);
+	const char *hz = getenv("FRACTAL_REFRESH");
+	const int rate = hz ? atoi(hz) : DISPLAY_HZ;
+	gui.period = 1000.0 / (rate > 0 ? MIN(rate, DISPLAY_MAX_HZ) : DISPLAY_HZ);
+	gui.published = 0;
+	gui.back = new_frame();
+	gui.front = new_frame();
+	gui.missing_count = 0;
+	gui.closing = false;
+	gui.stale = true;
+	gui.pending[0] = (grid_rect){.w = gui.w, .h = gui.h};
+	gui.pending_count = 1;
+	if (pthread_create(&gui.display, NULL, win_thread, NULL))
+	{
+		ERROR("Could not start the display thread.\n");
+		exit(100);
+	}
+	pthread_mutex_lock(&gui.mtx);
+	while (!gui.open)
+	{
+		pthread_cond_wait(&gui.cond, &gui.mtx);
+	}
+	pthread_mutex_unlock(&gui.mtx);
 }
 
-/* FREE THE ALLOCATED MEMORY FOR IMAGE */
+/* STOP THE DISPLAY THREAD, IT CLOSES THE WINDOW, AND FREE THE FRAMES */
 void gui_cleanup(void)
 {
-	if (gui.img)
+	if (!gui.open)
 	{
-		free(gui.img);
-		gui.img = NULL;
+		return;
 	}
-	xwin_close();
+	pthread_mutex_lock(&gui.mtx);
+	gui.closing = true;
+	pthread_cond_broadcast(&gui.cond);
+	pthread_mutex_unlock(&gui.mtx);
+	pthread_join(gui.display, NULL);
+	gui.open = false;
+	free(gui.back);
+	free(gui.front);
+	gui.back = gui.front = NULL;
 }
 
-/* UPDATE THE IMAGE DATA AND REDRAW THE FRACTAL IN GUI */
+/* COLOR THE CHANGED RECTANGLES OF THE GRID AND PUBLISH THEM, BOSS THREAD */
 void gui_refresh(void)
 {
-	if (gui.img)
+	if (gui.open)
 	{
-		update_image(gui.w, gui.h, gui.img);
-		xwin_redraw(gui.w, gui.h, gui.img);
-		xwin_poll_events();
+		grid_rect rects[DAMAGE_RECTS];
+		int count = take_damage(rects);
+		pthread_mutex_lock(&gui.draw);
+		if (gui.stale)
+		{
+			rects[0] = (grid_rect){.w = gui.w, .h = gui.h};
+			count = 1;
+			gui.stale = false;
+		}
+		if (count > 0) // the display thread goes on meanwhile
+		{
+			grid_rect draw[DAMAGE_RECTS]; // the changes and what back misses
+			int drawn = gui.missing_count;
+			memcpy(draw, gui.missing, drawn * sizeof(grid_rect));
+			for (int i = 0; i < count; i++)
+			{
+				add_rect(draw, &drawn, &rects[i]);
+			}
+			for (int i = 0; i < drawn; i++)
+			{
+				const grid_rect *r = &draw[i];
+				update_pixels(r, gui.back + r->y * gui.w + r->x,
+							  gui.w * sizeof(uint32_t), gui.format);
+			}
+			publish(rects, count);
+		}
+		pthread_mutex_unlock(&gui.draw);
+		gui.published = get_time_ms();
+	}
+}
+
+/* REFRESH IF THE WINDOW IS DUE, FOR THE PIXELS STREAMING IN FROM NUCLEO */
+void gui_update(void)
+{
+	if (get_time_ms() - gui.published >= gui.period)
+	{
+		gui_refresh();
 	}
 }
 
+/* DRAW THE IMAGE OF THE GRID SIZE, THE GRID ITSELF STAYS AS IT IS */
+void gui_show(unsigned char *img)
+{
+	const grid_rect all = {.w = gui.w, .h = gui.h};
+	pthread_mutex_lock(&gui.draw);
+	xwin_convert(gui.w, gui.h, img, gui.back, gui.w * sizeof(uint32_t));
+	gui.stale = true; // the next refresh draws the whole grid again
+	publish(&all, 1);
+	pthread_mutex_unlock(&gui.draw);
+}
+
+/* HAND A COPY OF THE FRAME TO THE IMAGE WRITERS, THE BOSS DOES NOT WAIT */
+void gui_save(void)
+{
+	const size_t size = gui.w * gui.h * sizeof(uint32_t);
+	uint32_t *copy = my_alloc(size);
+	pthread_mutex_lock(&gui.mtx);
+	memcpy(copy, gui.front, size);
+	pthread_mutex_unlock(&gui.mtx);
+	writer_save(gui.w, gui.h, copy);
+}
+
 /* PRINT THE WELCOME SCREEN WITH SETTINGS */
 void print_gui(void)
 {
@@ -64,21 +310,37 @@ void print_gui(void)
 		"║ l - clear the calculation buffer                               ║\n"
 		"║ p - redraws the contents of the window with the current buffer ║\n"
 		"║ c - compute fractal on PC                                      ║\n"
-		"║ m - animate fractal                                            ║\n"
+		"║ m - animate fractal, a stops it                                ║\n"
 		"║ q - terminate threads and close the program                    ║\n"
 		"║ + - increase the paramer c if it is not computing              ║\n"
 		"║ - - decrease the paramer c if it is not computing              ║\n"
+		"║ z - zoom in 2x around the view centre, deep zoom included      ║\n"
+		"║ x - zoom out 2x around the view centre                         ║\n"
+		"║ ←/→/↓/↑ - pan the view by 1/8, the overlap is not recomputed   ║\n"
+		"║ * - double the iterations, deepening continues the orbits      ║\n"
+		"║ i - keep deepening while idle                                  ║\n"
 		"║                                                                ║\n"
 		"║ INTERACTIVE SHORTCUTS:                                         ║\n"
 		"║ ←/→/↓/↑  adjust resolution                                     ║\n"
 		"║ 8/6/5/4  adjust chunk size                                     ║\n"
 		"║ -/+      decrease / increase number of iterations              ║\n"
+		"║ / *      halve / double number of iterations                   ║\n"
 		"║ k/o      decrease / increase real part of parameter            ║\n"
 		"║ j/i      decrease / increase imaginary part of parameter       ║\n"
 		"║ 1/3      decrease / increase real axes min computation range   ║\n"
 		"║ 7/9      decrease / increase real axes max computation range   ║\n"
 		"║ h/u      decrease / increase imaginary min axes range          ║\n"
 		"║ f/t      decrease / increase imaginary max axes range          ║\n"
+		"║ p        enable / disable periodicity check                    ║\n"
+		"║ b        enable / disable rectangle subdivision                ║\n"
+		"║ e        precision ladder, auto and mixed are approximate      ║\n"
+		"║ v        enable / disable smooth coloring                      ║\n"
+		"║ d        enable / disable distance estimation supersampling    ║\n"
+		"║ r        enable / disable progressive rendering                ║\n"
+		"║ c        tile cache off / 16 / 64 / 256 MB                     ║\n"
+		"║ w        enable / disable iteration deepening                  ║\n"
+		"║ m        julia / mandelbrot / burning ship                     ║\n"
+		"║ z        power d of z^d + c from 2 to 8                        ║\n"
 		"║ y/n      enable / disable image download                       ║\n"
 		"║                                                                ║\n"
 		"║ ACTIVE SETTINGS:                                               ║\n"
@@ -89,6 +351,15 @@ void print_gui(void)
 		"║ parameter imaginary  part:         +0.6 i                      ║\n"
 		"║ range of real axes:                -1.6 -> +1.6                ║\n"
 		"║ range of imaginary axes:           -1.1 -> +1.1                ║\n"
+		"║ periodicity check:                  no                         ║\n"
+		"║ rectangle subdivision:              no                         ║\n"
+		"║ precision ladder:                   double                     ║\n"
+		"║ smooth coloring:                    no                         ║\n"
+		"║ distance estimation:                no                         ║\n"
+		"║ progressive rendering:              yes                        ║\n"
+		"║ tile cache:                         64  MB                     ║\n"
+		"║ iteration deepening:                no                         ║\n"
+		"║ formula:                            julia        z^2           ║\n"
 		"║ download image:                     yes                        ║\n"
 		"║                                                                ║\n"
 		"║                                                                ║\n"
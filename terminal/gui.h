@@ -8,6 +8,9 @@
 void gui_init(void);
 void gui_cleanup(void);
 void gui_refresh(void);
+void gui_update(void);
+void gui_show(unsigned char *img);
+void gui_save(void);
 void *win_thread(void *arg);
 void print_gui(void);
 
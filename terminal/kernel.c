@@ -0,0 +1,1146 @@
+///////////////////////////////////////////////////////////////////////////////
+//  VECTORIZED ESCAPE TIME KERNELS SELECTED AT RUNTIME
+///////////////////////////////////////////////////////////////////////////////
+
+// fused multiply-add rounds differently, the lanes must match compute_iter()
+#pragma GCC optimize("fp-contract=off")
+
+#include "kernel.h"
+#include "computation.h"
+#include "my_functions.h"
+#include <immintrin.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PERIODICITY_EPS 1e-20 // squared distance treated as the same point
+#define PERIODICITY_EPS_F 1e-11f // the same in float, about 50 ulps of 1
+#define KERNEL_BLOCK 64		  // pixels of one row passed to the kernel at once
+#define FLOAT_PADDING 4.0f	  // coordinate of the unused float lanes
+
+typedef int (*row_function)(const kernel_params *p, const double *re,
+							const double *im, int count, uint32_t *out,
+							float *mag, double *z_re, double *z_im);
+typedef int (*row_function_f)(const kernel_params *p, const float *re,
+							  const float *im, int count, uint32_t *out,
+							  float *mag, double *z_re, double *z_im);
+
+/* ONE IMPLEMENTATION OF THE KERNEL */
+typedef struct
+{
+	const char *name;  // name printed in the log and used in FRACTAL_KERNEL
+	int lanes;			   // pixels iterated at once in double
+	row_function func;	   // computes one row of pixels
+	row_function_f func_f; // the same in float, twice the lanes
+} kernel;
+
+static int row_scalar(const kernel_params *p, const double *re,
+					  const double *im, int count, uint32_t *out,
+					  float *mag, double *z_re, double *z_im);
+static int row_sse2(const kernel_params *p, const double *re,
+					const double *im, int count, uint32_t *out,
+					float *mag, double *z_re, double *z_im);
+static int row_avx2(const kernel_params *p, const double *re,
+					const double *im, int count, uint32_t *out,
+					float *mag, double *z_re, double *z_im);
+static int row_avx512(const kernel_params *p, const double *re,
+					  const double *im, int count, uint32_t *out,
+					  float *mag, double *z_re, double *z_im);
+static int row_scalar_f(const kernel_params *p, const float *re,
+						const float *im, int count, uint32_t *out,
+						float *mag, double *z_re, double *z_im);
+static int row_sse2_f(const kernel_params *p, const float *re,
+					  const float *im, int count, uint32_t *out,
+					  float *mag, double *z_re, double *z_im);
+static int row_avx2_f(const kernel_params *p, const float *re,
+					  const float *im, int count, uint32_t *out,
+					  float *mag, double *z_re, double *z_im);
+static int row_avx512_f(const kernel_params *p, const float *re,
+						const float *im, int count, uint32_t *out,
+						float *mag, double *z_re, double *z_im);
+
+static row_function formula_kernel(int formula, int power);
+
+/* FROM THE WIDEST TO THE SCALAR FALLBACK */
+static const kernel kernels[] = {
+	{.name = "avx512", .lanes = 8, .func = row_avx512, .func_f = row_avx512_f},
+	{.name = "avx2", .lanes = 4, .func = row_avx2, .func_f = row_avx2_f},
+	{.name = "sse2", .lanes = 2, .func = row_sse2, .func_f = row_sse2_f},
+	{.name = "scalar", .lanes = 1, .func = row_scalar, .func_f = row_scalar_f},
+};
+
+static const kernel *active = &kernels[3];
+
+/* CPUID CHECK, __BUILTIN_CPU_SUPPORTS() ACCEPTS ONLY STRING LITERALS */
+static bool is_supported(const kernel *k)
+{
+	bool ret = true;
+	if (k->func == row_avx512)
+	{
+		ret = __builtin_cpu_supports("avx512f");
+	}
+	else if (k->func == row_avx2)
+	{
+		ret = __builtin_cpu_supports("avx2");
+	}
+	else if (k->func == row_sse2)
+	{
+		ret = __builtin_cpu_supports("sse2");
+	}
+	return ret;
+}
+
+/* PICK THE WIDEST KERNEL SUPPORTED BY THE CPU, FRACTAL_KERNEL CAN FORCE ONE */
+void kernel_init(void)
+{
+	const char *forced = getenv("FRACTAL_KERNEL");
+	const int nbr_kernels = sizeof(kernels) / sizeof(kernels[0]);
+	__builtin_cpu_init();
+	active = NULL;
+	for (int i = 0; i < nbr_kernels && forced; ++i)
+	{
+		if (strcmp(forced, kernels[i].name) == 0 && is_supported(&kernels[i]))
+		{
+			active = &kernels[i];
+		}
+	}
+	if (forced && !active)
+	{
+		WARN("FRACTAL_KERNEL is unknown or not supported by this CPU\n");
+	}
+	for (int i = 0; i < nbr_kernels && !active; ++i)
+	{
+		if (is_supported(&kernels[i]))
+		{
+			active = &kernels[i];
+		}
+	}
+	INFOF("Escape time kernel: %s (%d pixels per step, %d in float)\n",
+		  active->name, active->lanes,
+		  active->func == row_scalar ? 1 : 2 * active->lanes);
+}
+
+/* RETURN THE NAME OF THE SELECTED KERNEL */
+const char *kernel_name(void)
+{
+	return active->name;
+}
+
+/* RETURN THE NUMBER OF PIXELS ITERATED TOGETHER */
+int kernel_lanes(void)
+{
+	return active->lanes;
+}
+
+/* RETURN TRUE IF THE FORMULA IS ITERATED IN FLOAT WHEN ASKED TO */
+bool kernel_single(int formula, int power)
+{
+	return formula_kernel(formula, power) == NULL; // the vector ones only
+}
+
+/* ROUND THE COORDINATES TO FLOAT BLOCK BY BLOCK AND ITERATE THEM */
+static int points_float(const kernel_params *p, const double *re,
+						const double *im, int count, uint32_t *out, float *mag,
+						double *z_re, double *z_im)
+{
+	const int lanes = active->func == row_scalar ? 1 : 2 * active->lanes;
+	float re_f[KERNEL_BLOCK];
+	float im_f[KERNEL_BLOCK];
+	uint32_t out_f[KERNEL_BLOCK];
+	float mag_f[KERNEL_BLOCK];
+	double z_re_f[KERNEL_BLOCK];
+	double z_im_f[KERNEL_BLOCK];
+	int cycles = 0;
+	for (int i = 0; i < count; i += KERNEL_BLOCK)
+	{
+		const int n = count - i < KERNEL_BLOCK ? count - i : KERNEL_BLOCK;
+		const int padded = (n + lanes - 1) / lanes * lanes;
+		for (int j = 0; j < n; j++)
+		{
+			re_f[j] = re[i + j];
+			im_f[j] = im[i + j];
+		}
+		for (int j = n; j < padded; j++) // escape at once, no scalar tail
+		{
+			re_f[j] = im_f[j] = FLOAT_PADDING;
+		}
+		cycles += active->func_f(p, re_f, im_f, padded, out_f,
+								 mag ? mag_f : NULL, z_re ? z_re_f : NULL,
+								 z_im_f);
+		memcpy(out + i, out_f, n * sizeof(uint32_t));
+		if (mag)
+		{
+			memcpy(mag + i, mag_f, n * sizeof(float));
+		}
+		if (z_re)
+		{
+			memcpy(z_re + i, z_re_f, n * sizeof(double));
+			memcpy(z_im + i, z_im_f, n * sizeof(double));
+		}
+	}
+	return cycles;
+}
+
+/* ITERATE THE POINTS WITH THE SELECTED VECTOR KERNEL */
+static int points_vector(const kernel_params *p, const double *re,
+						 const double *im, int count, uint32_t *out,
+						 float *mag, double *z_re, double *z_im)
+{
+	return p->single ? points_float(p, re, im, count, out, mag, z_re, z_im)
+					 : active->func(p, re, im, count, out, mag, z_re, z_im);
+}
+
+/* RETURN TRUE IF C LIES IN THE MAIN CARDIOID OR THE PERIOD-2 BULB OF Z^2 */
+static inline bool in_main_bulbs(double x, double y)
+{
+	const double xq = x - 0.25;
+	const double q = xq * xq + y * y;
+	return q * (q + xq) <= 0.25 * y * y ||
+		   (x + 1) * (x + 1) + y * y <= 0.0625;
+}
+
+/*
+ * The pixels of the mandelbrot set in its main cardioid or its period-2 bulb
+ * never escape, they get the interior value at once without an orbit. Only
+ * the others are packed for the vector kernels, so no lane idles on them.
+ */
+static int points_outside(const kernel_params *p, const double *re,
+						  const double *im, int count, uint32_t *out,
+						  float *mag, double *z_re, double *z_im)
+{
+	double re_o[KERNEL_BLOCK];
+	double im_o[KERNEL_BLOCK];
+	int idx[KERNEL_BLOCK];
+	uint32_t out_o[KERNEL_BLOCK];
+	float mag_o[KERNEL_BLOCK];
+	double z_re_o[KERNEL_BLOCK];
+	double z_im_o[KERNEL_BLOCK];
+	int cycles = 0;
+	for (int i = 0; i < count; i += KERNEL_BLOCK)
+	{
+		const int n = MIN(count - i, KERNEL_BLOCK);
+		int m = 0;
+		for (int j = i; j < i + n; j++)
+		{
+			if (!in_main_bulbs(re[j], im[j]))
+			{
+				re_o[m] = re[j];
+				im_o[m] = im[j];
+				idx[m++] = j;
+				continue;
+			}
+			out[j] = p->max_iteration + 1;
+			if (mag)
+			{
+				mag[j] = 0;
+			}
+			if (z_re)
+			{
+				z_re[j] = z_im[j] = NAN;
+			}
+		}
+		if (m == 0)
+		{
+			continue;
+		}
+		cycles += points_vector(p, re_o, im_o, m, out_o, mag ? mag_o : NULL,
+								z_re ? z_re_o : NULL, z_im_o);
+		for (int j = 0; j < m; j++)
+		{
+			out[idx[j]] = out_o[j];
+		}
+		for (int j = 0; j < m && mag; j++)
+		{
+			mag[idx[j]] = mag_o[j];
+		}
+		for (int j = 0; j < m && z_re; j++)
+		{
+			z_re[idx[j]] = z_re_o[j];
+			z_im[idx[j]] = z_im_o[j];
+		}
+	}
+	return cycles;
+}
+
+/* COMPUTE COUNT PIXELS GIVEN BY THEIR COORDINATES, RETURN CYCLE EXITS */
+int kernel_points(const kernel_params *p, const double *re, const double *im,
+				  int count, uint32_t *out, float *mag, double *z_re,
+				  double *z_im)
+{
+	const row_function specialized = formula_kernel(p->formula, p->power);
+	if (specialized)
+	{
+		return specialized(p, re, im, count, out, mag, z_re, z_im);
+	}
+	return p->formula == FORMULA_MANDELBROT
+			   ? points_outside(p, re, im, count, out, mag, z_re, z_im)
+			   : points_vector(p, re, im, count, out, mag, z_re, z_im);
+}
+
+/* COMPUTE COUNT PIXELS OF ONE ROW, RETURN HOW MANY ENDED ON A CYCLE */
+int kernel_row(const kernel_params *p, const double *re, double im,
+			   int count, uint32_t *out, float *mag, double *z_re,
+			   double *z_im)
+{
+	double row_im[KERNEL_BLOCK];
+	int cycles = 0;
+	for (int i = 0; i < KERNEL_BLOCK; i++)
+	{
+		row_im[i] = im;
+	}
+	for (int i = 0; i < count; i += KERNEL_BLOCK)
+	{
+		const int n = count - i < KERNEL_BLOCK ? count - i : KERNEL_BLOCK;
+		cycles += kernel_points(p, re + i, row_im, n, out + i,
+								mag ? mag + i : NULL, z_re ? z_re + i : NULL,
+								z_im ? z_im + i : NULL);
+	}
+	return cycles;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  IMPLEMENTATIONS
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * All kernels iterate in lockstep, the periodicity check is Brent's: the orbit
+ * point is saved after 1, 2, 4, 8... iterations and every following point is
+ * compared with it. An orbit which returns to the saved point lies on an
+ * attracting cycle and never escapes, so it gets the interior value at once.
+ * When mag is given, the squared magnitude of every escaped point is stored
+ * there for the smooth coloring, the interior pixels get 0. When z_re and
+ * z_im are given, they get the last orbit point of every pixel, an interior
+ * one can be continued from it when the number of iterations grows.
+ * The julia set of z^2 + c iterates the pixels with the constant c, the
+ * mandelbrot set takes every pixel as its own c and starts from z = 0. Its
+ * first step always lands on z = c, so the orbit starts there with that
+ * step already counted.
+ */
+
+/* REFERENCE PATH, ONE PIXEL AT A TIME */
+static int row_scalar(const kernel_params *p, const double *re, const double *im,
+					  int count, uint32_t *out, float *mag, double *z_re,
+					  double *z_im)
+{
+	const bool mandelbrot = p->formula == FORMULA_MANDELBROT; // c is the pixel
+	const uint32_t first = mandelbrot; // the step from z = 0 to z = c
+	int cycles = 0;
+	for (int i = 0; i < count; i++)
+	{
+		double px = re[i], py = im[i];
+		const double cr = mandelbrot ? px : p->c_re;
+		const double ci = mandelbrot ? py : p->c_im;
+		double saved_x = px, saved_y = py;
+		double exit_mag = 0;
+		uint32_t ret = first, next_save = first + 1;
+		while (ret <= p->max_iteration)
+		{
+			const double mag2 = px * px + py * py;
+			if (!(mag2 < 4))
+			{
+				exit_mag = mag2;
+				break;
+			}
+			double temp = px * px - py * py + cr;
+			py = 2 * px * py + ci;
+			px = temp;
+			ret++;
+			if (!p->periodicity)
+			{
+				continue;
+			}
+			const double dx = px - saved_x, dy = py - saved_y;
+			if (dx * dx + dy * dy < PERIODICITY_EPS)
+			{
+				ret = p->max_iteration + 1;
+				cycles++;
+				break;
+			}
+			if (ret == next_save)
+			{
+				saved_x = px;
+				saved_y = py;
+				next_save *= 2;
+			}
+		}
+		out[i] = ret;
+		if (mag)
+		{
+			mag[i] = exit_mag;
+		}
+		if (z_re)
+		{
+			z_re[i] = px;
+			z_im[i] = py;
+		}
+	}
+	return cycles;
+}
+
+/* TWO PIXELS PER STEP, EVERY X86-64 CPU HAS SSE2 */
+__attribute__((target("sse2"))) static int
+row_sse2(const kernel_params *p, const double *re, const double *im,
+		 int count, uint32_t *out, float *mag, double *z_re,
+		 double *z_im)
+{
+	const __m128d c_re = _mm_set1_pd(p->c_re);
+	const __m128d c_im = _mm_set1_pd(p->c_im);
+	const bool mandelbrot = p->formula == FORMULA_MANDELBROT; // c is the pixel
+	const uint32_t first = mandelbrot; // the step from z = 0 to z = c
+	const __m128d two = _mm_set1_pd(2.0);
+	const __m128d four = _mm_set1_pd(4.0);
+	const __m128d one = _mm_set1_pd(1.0);
+	const __m128d eps = _mm_set1_pd(PERIODICITY_EPS);
+	const __m128d interior = _mm_set1_pd(p->max_iteration + 1.0);
+	int cycles = 0;
+	int i = 0;
+	for (; i + 2 <= count; i += 2)
+	{
+		__m128d px = _mm_loadu_pd(re + i);
+		__m128d py = _mm_loadu_pd(im + i);
+		const __m128d cr = mandelbrot ? px : c_re;
+		const __m128d ci = mandelbrot ? py : c_im;
+		__m128d saved_x = px, saved_y = py;
+		__m128d iter = _mm_set1_pd(first);
+		__m128d exit_mag = _mm_setzero_pd();
+		__m128d alive = _mm_cmpeq_pd(iter, iter); // all lanes iterate
+		for (uint32_t k = first, next_save = first + 1; k <= p->max_iteration;
+			 k++)
+		{
+			const __m128d xx = _mm_mul_pd(px, px);
+			const __m128d yy = _mm_mul_pd(py, py);
+			const __m128d mag2 = _mm_add_pd(xx, yy);
+			const __m128d inside = _mm_cmplt_pd(mag2, four);
+			const __m128d escaped = _mm_andnot_pd(inside, alive);
+			exit_mag = _mm_or_pd(_mm_andnot_pd(escaped, exit_mag),
+								 _mm_and_pd(escaped, mag2));
+			alive = _mm_and_pd(alive, inside);
+			if (_mm_movemask_pd(alive) == 0)
+			{
+				break;
+			}
+			iter = _mm_add_pd(iter, _mm_and_pd(alive, one));
+			const __m128d temp = _mm_add_pd(_mm_sub_pd(xx, yy), cr);
+			py = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(two, px), py), ci);
+			px = temp;
+			if (p->periodicity)
+			{
+				const __m128d dx = _mm_sub_pd(px, saved_x);
+				const __m128d dy = _mm_sub_pd(py, saved_y);
+				const __m128d dist = _mm_add_pd(_mm_mul_pd(dx, dx),
+												_mm_mul_pd(dy, dy));
+				const __m128d cycled = _mm_and_pd(alive, _mm_cmplt_pd(dist, eps));
+				const int mask = _mm_movemask_pd(cycled);
+				if (mask)
+				{
+					cycles += __builtin_popcount(mask);
+					iter = _mm_or_pd(_mm_andnot_pd(cycled, iter),
+									 _mm_and_pd(cycled, interior));
+					alive = _mm_andnot_pd(cycled, alive);
+				}
+				if (k + 1 == next_save)
+				{
+					saved_x = px;
+					saved_y = py;
+					next_save *= 2;
+				}
+			}
+		}
+		_mm_storel_epi64((__m128i *)(out + i), _mm_cvttpd_epi32(iter));
+		if (mag)
+		{
+			_mm_storel_pi((__m64 *)(mag + i), _mm_cvtpd_ps(exit_mag));
+		}
+		if (z_re)
+		{
+			_mm_storeu_pd(z_re + i, px);
+			_mm_storeu_pd(z_im + i, py);
+		}
+	}
+	return cycles + row_scalar(p, re + i, im + i, count - i, out + i,
+							   mag ? mag + i : NULL, z_re ? z_re + i : NULL,
+							   z_im ? z_im + i : NULL);
+}
+
+/* FOUR PIXELS PER STEP */
+__attribute__((target("avx2"))) static int
+row_avx2(const kernel_params *p, const double *re, const double *im,
+		 int count, uint32_t *out, float *mag, double *z_re,
+		 double *z_im)
+{
+	const __m256d c_re = _mm256_set1_pd(p->c_re);
+	const __m256d c_im = _mm256_set1_pd(p->c_im);
+	const bool mandelbrot = p->formula == FORMULA_MANDELBROT; // c is the pixel
+	const uint32_t first = mandelbrot; // the step from z = 0 to z = c
+	const __m256d two = _mm256_set1_pd(2.0);
+	const __m256d four = _mm256_set1_pd(4.0);
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d eps = _mm256_set1_pd(PERIODICITY_EPS);
+	const __m256d interior = _mm256_set1_pd(p->max_iteration + 1.0);
+	int cycles = 0;
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m256d px = _mm256_loadu_pd(re + i);
+		__m256d py = _mm256_loadu_pd(im + i);
+		const __m256d cr = mandelbrot ? px : c_re;
+		const __m256d ci = mandelbrot ? py : c_im;
+		__m256d saved_x = px, saved_y = py;
+		__m256d iter = _mm256_set1_pd(first);
+		__m256d exit_mag = _mm256_setzero_pd();
+		__m256d alive = _mm256_cmp_pd(iter, iter, _CMP_EQ_OQ);
+		for (uint32_t k = first, next_save = first + 1; k <= p->max_iteration;
+			 k++)
+		{
+			const __m256d xx = _mm256_mul_pd(px, px);
+			const __m256d yy = _mm256_mul_pd(py, py);
+			const __m256d mag2 = _mm256_add_pd(xx, yy);
+			const __m256d inside = _mm256_cmp_pd(mag2, four, _CMP_LT_OQ);
+			exit_mag = _mm256_blendv_pd(exit_mag, mag2,
+										_mm256_andnot_pd(inside, alive));
+			alive = _mm256_and_pd(alive, inside);
+			if (_mm256_movemask_pd(alive) == 0)
+			{
+				break;
+			}
+			iter = _mm256_add_pd(iter, _mm256_and_pd(alive, one));
+			const __m256d temp = _mm256_add_pd(_mm256_sub_pd(xx, yy), cr);
+			py = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(two, px), py), ci);
+			px = temp;
+			if (p->periodicity)
+			{
+				const __m256d dx = _mm256_sub_pd(px, saved_x);
+				const __m256d dy = _mm256_sub_pd(py, saved_y);
+				const __m256d dist = _mm256_add_pd(_mm256_mul_pd(dx, dx),
+												   _mm256_mul_pd(dy, dy));
+				const __m256d cycled =
+					_mm256_and_pd(alive, _mm256_cmp_pd(dist, eps, _CMP_LT_OQ));
+				const int mask = _mm256_movemask_pd(cycled);
+				if (mask)
+				{
+					cycles += __builtin_popcount(mask);
+					iter = _mm256_blendv_pd(iter, interior, cycled);
+					alive = _mm256_andnot_pd(cycled, alive);
+				}
+				if (k + 1 == next_save)
+				{
+					saved_x = px;
+					saved_y = py;
+					next_save *= 2;
+				}
+			}
+		}
+		_mm_storeu_si128((__m128i *)(out + i), _mm256_cvttpd_epi32(iter));
+		if (mag)
+		{
+			_mm_storeu_ps(mag + i, _mm256_cvtpd_ps(exit_mag));
+		}
+		if (z_re)
+		{
+			_mm256_storeu_pd(z_re + i, px);
+			_mm256_storeu_pd(z_im + i, py);
+		}
+	}
+	_mm256_zeroupper(); // gcc leaves the upper halves dirty, sse code after stalls
+	return cycles + row_scalar(p, re + i, im + i, count - i, out + i,
+							   mag ? mag + i : NULL, z_re ? z_re + i : NULL,
+							   z_im ? z_im + i : NULL);
+}
+
+/* EIGHT PIXELS PER STEP, THE ESCAPED LANES ARE MASKED OUT */
+__attribute__((target("avx512f"))) static int
+row_avx512(const kernel_params *p, const double *re, const double *im,
+		   int count, uint32_t *out, float *mag, double *z_re,
+		   double *z_im)
+{
+	const __m512d c_re = _mm512_set1_pd(p->c_re);
+	const __m512d c_im = _mm512_set1_pd(p->c_im);
+	const bool mandelbrot = p->formula == FORMULA_MANDELBROT; // c is the pixel
+	const uint32_t first = mandelbrot; // the step from z = 0 to z = c
+	const __m512d two = _mm512_set1_pd(2.0);
+	const __m512d four = _mm512_set1_pd(4.0);
+	const __m512d one = _mm512_set1_pd(1.0);
+	const __m512d eps = _mm512_set1_pd(PERIODICITY_EPS);
+	const __m512d interior = _mm512_set1_pd(p->max_iteration + 1.0);
+	int cycles = 0;
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m512d px = _mm512_loadu_pd(re + i);
+		__m512d py = _mm512_loadu_pd(im + i);
+		const __m512d cr = mandelbrot ? px : c_re;
+		const __m512d ci = mandelbrot ? py : c_im;
+		__m512d saved_x = px, saved_y = py;
+		__m512d iter = _mm512_set1_pd(first);
+		__m512d exit_mag = _mm512_setzero_pd();
+		__mmask8 alive = 0xff;
+		for (uint32_t k = first, next_save = first + 1; k <= p->max_iteration;
+			 k++)
+		{
+			const __m512d xx = _mm512_mul_pd(px, px);
+			const __m512d yy = _mm512_mul_pd(py, py);
+			const __m512d mag2 = _mm512_add_pd(xx, yy);
+			const __mmask8 inside = _mm512_cmp_pd_mask(mag2, four, _CMP_LT_OQ);
+			exit_mag = _mm512_mask_mov_pd(exit_mag, alive & ~inside, mag2);
+			alive &= inside;
+			if (alive == 0)
+			{
+				break;
+			}
+			iter = _mm512_mask_add_pd(iter, alive, iter, one);
+			const __m512d temp = _mm512_add_pd(_mm512_sub_pd(xx, yy), cr);
+			py = _mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(two, px), py), ci);
+			px = temp;
+			if (p->periodicity)
+			{
+				const __m512d dx = _mm512_sub_pd(px, saved_x);
+				const __m512d dy = _mm512_sub_pd(py, saved_y);
+				const __m512d dist = _mm512_add_pd(_mm512_mul_pd(dx, dx),
+												   _mm512_mul_pd(dy, dy));
+				const __mmask8 cycled =
+					alive & _mm512_cmp_pd_mask(dist, eps, _CMP_LT_OQ);
+				if (cycled)
+				{
+					cycles += __builtin_popcount(cycled);
+					iter = _mm512_mask_mov_pd(iter, cycled, interior);
+					alive &= ~cycled;
+				}
+				if (k + 1 == next_save)
+				{
+					saved_x = px;
+					saved_y = py;
+					next_save *= 2;
+				}
+			}
+		}
+		_mm256_storeu_si256((__m256i *)(out + i), _mm512_cvttpd_epi32(iter));
+		if (mag)
+		{
+			_mm256_storeu_ps(mag + i, _mm512_cvtpd_ps(exit_mag));
+		}
+		if (z_re)
+		{
+			_mm512_storeu_pd(z_re + i, px);
+			_mm512_storeu_pd(z_im + i, py);
+		}
+	}
+	_mm256_zeroupper();
+	return cycles + row_scalar(p, re + i, im + i, count - i, out + i,
+							   mag ? mag + i : NULL, z_re ? z_re + i : NULL,
+							   z_im ? z_im + i : NULL);
+}
+
+/* FLOAT REFERENCE PATH, ONE PIXEL AT A TIME */
+static int row_scalar_f(const kernel_params *p, const float *re,
+						const float *im, int count, uint32_t *out, float *mag,
+						double *z_re, double *z_im)
+{
+	const float c_re = p->c_re, c_im = p->c_im;
+	const bool mandelbrot = p->formula == FORMULA_MANDELBROT; // c is the pixel
+	const uint32_t first = mandelbrot; // the step from z = 0 to z = c
+	int cycles = 0;
+	for (int i = 0; i < count; i++)
+	{
+		float px = re[i], py = im[i];
+		const float cr = mandelbrot ? px : c_re;
+		const float ci = mandelbrot ? py : c_im;
+		float saved_x = px, saved_y = py;
+		float exit_mag = 0;
+		uint32_t ret = first, next_save = first + 1;
+		while (ret <= p->max_iteration)
+		{
+			const float mag2 = px * px + py * py;
+			if (!(mag2 < 4))
+			{
+				exit_mag = mag2;
+				break;
+			}
+			float temp = px * px - py * py + cr;
+			py = 2 * px * py + ci;
+			px = temp;
+			ret++;
+			if (!p->periodicity)
+			{
+				continue;
+			}
+			const float dx = px - saved_x, dy = py - saved_y;
+			if (dx * dx + dy * dy < PERIODICITY_EPS_F)
+			{
+				ret = p->max_iteration + 1;
+				cycles++;
+				break;
+			}
+			if (ret == next_save)
+			{
+				saved_x = px;
+				saved_y = py;
+				next_save *= 2;
+			}
+		}
+		out[i] = ret;
+		if (mag)
+		{
+			mag[i] = exit_mag;
+		}
+		if (z_re)
+		{
+			z_re[i] = px;
+			z_im[i] = py;
+		}
+	}
+	return cycles;
+}
+
+/* FOUR FLOAT PIXELS PER STEP */
+__attribute__((target("sse2"))) static int
+row_sse2_f(const kernel_params *p, const float *re, const float *im,
+		   int count, uint32_t *out, float *mag, double *z_re,
+		   double *z_im)
+{
+	const __m128 c_re = _mm_set1_ps(p->c_re);
+	const __m128 c_im = _mm_set1_ps(p->c_im);
+	const bool mandelbrot = p->formula == FORMULA_MANDELBROT; // c is the pixel
+	const uint32_t first = mandelbrot; // the step from z = 0 to z = c
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 four = _mm_set1_ps(4.0f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 eps = _mm_set1_ps(PERIODICITY_EPS_F);
+	const __m128 interior = _mm_set1_ps(p->max_iteration + 1.0f);
+	int cycles = 0;
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 px = _mm_loadu_ps(re + i);
+		__m128 py = _mm_loadu_ps(im + i);
+		const __m128 cr = mandelbrot ? px : c_re;
+		const __m128 ci = mandelbrot ? py : c_im;
+		__m128 saved_x = px, saved_y = py;
+		__m128 iter = _mm_set1_ps(first);
+		__m128 exit_mag = _mm_setzero_ps();
+		__m128 alive = _mm_cmpeq_ps(iter, iter);
+		for (uint32_t k = first, next_save = first + 1; k <= p->max_iteration;
+			 k++)
+		{
+			const __m128 xx = _mm_mul_ps(px, px);
+			const __m128 yy = _mm_mul_ps(py, py);
+			const __m128 mag2 = _mm_add_ps(xx, yy);
+			const __m128 inside = _mm_cmplt_ps(mag2, four);
+			const __m128 escaped = _mm_andnot_ps(inside, alive);
+			exit_mag = _mm_or_ps(_mm_andnot_ps(escaped, exit_mag),
+								 _mm_and_ps(escaped, mag2));
+			alive = _mm_and_ps(alive, inside);
+			if (_mm_movemask_ps(alive) == 0)
+			{
+				break;
+			}
+			iter = _mm_add_ps(iter, _mm_and_ps(alive, one));
+			const __m128 temp = _mm_add_ps(_mm_sub_ps(xx, yy), cr);
+			py = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(two, px), py), ci);
+			px = temp;
+			if (p->periodicity)
+			{
+				const __m128 dx = _mm_sub_ps(px, saved_x);
+				const __m128 dy = _mm_sub_ps(py, saved_y);
+				const __m128 dist = _mm_add_ps(_mm_mul_ps(dx, dx),
+											   _mm_mul_ps(dy, dy));
+				const __m128 cycled = _mm_and_ps(alive, _mm_cmplt_ps(dist, eps));
+				const int mask = _mm_movemask_ps(cycled);
+				if (mask)
+				{
+					cycles += __builtin_popcount(mask);
+					iter = _mm_or_ps(_mm_andnot_ps(cycled, iter),
+									 _mm_and_ps(cycled, interior));
+					alive = _mm_andnot_ps(cycled, alive);
+				}
+				if (k + 1 == next_save)
+				{
+					saved_x = px;
+					saved_y = py;
+					next_save *= 2;
+				}
+			}
+		}
+		_mm_storeu_si128((__m128i *)(out + i), _mm_cvttps_epi32(iter));
+		if (mag)
+		{
+			_mm_storeu_ps(mag + i, exit_mag);
+		}
+		if (z_re)
+		{
+			_mm_storeu_pd(z_re + i, _mm_cvtps_pd(px));
+			_mm_storeu_pd(z_re + i + 2, _mm_cvtps_pd(_mm_movehl_ps(px, px)));
+			_mm_storeu_pd(z_im + i, _mm_cvtps_pd(py));
+			_mm_storeu_pd(z_im + i + 2, _mm_cvtps_pd(_mm_movehl_ps(py, py)));
+		}
+	}
+	return cycles + row_scalar_f(p, re + i, im + i, count - i, out + i,
+								 mag ? mag + i : NULL, z_re ? z_re + i : NULL,
+								 z_im ? z_im + i : NULL);
+}
+
+/* EIGHT FLOAT PIXELS PER STEP */
+__attribute__((target("avx2"))) static int
+row_avx2_f(const kernel_params *p, const float *re, const float *im,
+		   int count, uint32_t *out, float *mag, double *z_re,
+		   double *z_im)
+{
+	const __m256 c_re = _mm256_set1_ps(p->c_re);
+	const __m256 c_im = _mm256_set1_ps(p->c_im);
+	const bool mandelbrot = p->formula == FORMULA_MANDELBROT; // c is the pixel
+	const uint32_t first = mandelbrot; // the step from z = 0 to z = c
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 four = _mm256_set1_ps(4.0f);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 eps = _mm256_set1_ps(PERIODICITY_EPS_F);
+	const __m256 interior = _mm256_set1_ps(p->max_iteration + 1.0f);
+	int cycles = 0;
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 px = _mm256_loadu_ps(re + i);
+		__m256 py = _mm256_loadu_ps(im + i);
+		const __m256 cr = mandelbrot ? px : c_re;
+		const __m256 ci = mandelbrot ? py : c_im;
+		__m256 saved_x = px, saved_y = py;
+		__m256 iter = _mm256_set1_ps(first);
+		__m256 exit_mag = _mm256_setzero_ps();
+		__m256 alive = _mm256_cmp_ps(iter, iter, _CMP_EQ_OQ);
+		for (uint32_t k = first, next_save = first + 1; k <= p->max_iteration;
+			 k++)
+		{
+			const __m256 xx = _mm256_mul_ps(px, px);
+			const __m256 yy = _mm256_mul_ps(py, py);
+			const __m256 mag2 = _mm256_add_ps(xx, yy);
+			const __m256 inside = _mm256_cmp_ps(mag2, four, _CMP_LT_OQ);
+			exit_mag = _mm256_blendv_ps(exit_mag, mag2,
+										_mm256_andnot_ps(inside, alive));
+			alive = _mm256_and_ps(alive, inside);
+			if (_mm256_movemask_ps(alive) == 0)
+			{
+				break;
+			}
+			iter = _mm256_add_ps(iter, _mm256_and_ps(alive, one));
+			const __m256 temp = _mm256_add_ps(_mm256_sub_ps(xx, yy), cr);
+			py = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(two, px), py), ci);
+			px = temp;
+			if (p->periodicity)
+			{
+				const __m256 dx = _mm256_sub_ps(px, saved_x);
+				const __m256 dy = _mm256_sub_ps(py, saved_y);
+				const __m256 dist = _mm256_add_ps(_mm256_mul_ps(dx, dx),
+												  _mm256_mul_ps(dy, dy));
+				const __m256 cycled =
+					_mm256_and_ps(alive, _mm256_cmp_ps(dist, eps, _CMP_LT_OQ));
+				const int mask = _mm256_movemask_ps(cycled);
+				if (mask)
+				{
+					cycles += __builtin_popcount(mask);
+					iter = _mm256_blendv_ps(iter, interior, cycled);
+					alive = _mm256_andnot_ps(cycled, alive);
+				}
+				if (k + 1 == next_save)
+				{
+					saved_x = px;
+					saved_y = py;
+					next_save *= 2;
+				}
+			}
+		}
+		_mm256_storeu_si256((__m256i *)(out + i), _mm256_cvttps_epi32(iter));
+		if (mag)
+		{
+			_mm256_storeu_ps(mag + i, exit_mag);
+		}
+		if (z_re)
+		{
+			_mm256_storeu_pd(z_re + i,
+							 _mm256_cvtps_pd(_mm256_castps256_ps128(px)));
+			_mm256_storeu_pd(z_re + i + 4,
+							 _mm256_cvtps_pd(_mm256_extractf128_ps(px, 1)));
+			_mm256_storeu_pd(z_im + i,
+							 _mm256_cvtps_pd(_mm256_castps256_ps128(py)));
+			_mm256_storeu_pd(z_im + i + 4,
+							 _mm256_cvtps_pd(_mm256_extractf128_ps(py, 1)));
+		}
+	}
+	_mm256_zeroupper();
+	return cycles + row_scalar_f(p, re + i, im + i, count - i, out + i,
+								 mag ? mag + i : NULL, z_re ? z_re + i : NULL,
+								 z_im ? z_im + i : NULL);
+}
+
+/* SIXTEEN FLOAT PIXELS PER STEP */
+__attribute__((target("avx512f"))) static int
+row_avx512_f(const kernel_params *p, const float *re, const float *im,
+			 int count, uint32_t *out, float *mag, double *z_re,
+			 double *z_im)
+{
+	const __m512 c_re = _mm512_set1_ps(p->c_re);
+	const __m512 c_im = _mm512_set1_ps(p->c_im);
+	const bool mandelbrot = p->formula == FORMULA_MANDELBROT; // c is the pixel
+	const uint32_t first = mandelbrot; // the step from z = 0 to z = c
+	const __m512 two = _mm512_set1_ps(2.0f);
+	const __m512 four = _mm512_set1_ps(4.0f);
+	const __m512 one = _mm512_set1_ps(1.0f);
+	const __m512 eps = _mm512_set1_ps(PERIODICITY_EPS_F);
+	const __m512 interior = _mm512_set1_ps(p->max_iteration + 1.0f);
+	int cycles = 0;
+	int i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m512 px = _mm512_loadu_ps(re + i);
+		__m512 py = _mm512_loadu_ps(im + i);
+		const __m512 cr = mandelbrot ? px : c_re;
+		const __m512 ci = mandelbrot ? py : c_im;
+		__m512 saved_x = px, saved_y = py;
+		__m512 iter = _mm512_set1_ps(first);
+		__m512 exit_mag = _mm512_setzero_ps();
+		__mmask16 alive = 0xffff;
+		for (uint32_t k = first, next_save = first + 1; k <= p->max_iteration;
+			 k++)
+		{
+			const __m512 xx = _mm512_mul_ps(px, px);
+			const __m512 yy = _mm512_mul_ps(py, py);
+			const __m512 mag2 = _mm512_add_ps(xx, yy);
+			const __mmask16 inside = _mm512_cmp_ps_mask(mag2, four, _CMP_LT_OQ);
+			exit_mag = _mm512_mask_mov_ps(exit_mag, alive & ~inside, mag2);
+			alive &= inside;
+			if (alive == 0)
+			{
+				break;
+			}
+			iter = _mm512_mask_add_ps(iter, alive, iter, one);
+			const __m512 temp = _mm512_add_ps(_mm512_sub_ps(xx, yy), cr);
+			py = _mm512_add_ps(_mm512_mul_ps(_mm512_mul_ps(two, px), py), ci);
+			px = temp;
+			if (p->periodicity)
+			{
+				const __m512 dx = _mm512_sub_ps(px, saved_x);
+				const __m512 dy = _mm512_sub_ps(py, saved_y);
+				const __m512 dist = _mm512_add_ps(_mm512_mul_ps(dx, dx),
+												  _mm512_mul_ps(dy, dy));
+				const __mmask16 cycled =
+					alive & _mm512_cmp_ps_mask(dist, eps, _CMP_LT_OQ);
+				if (cycled)
+				{
+					cycles += __builtin_popcount(cycled);
+					iter = _mm512_mask_mov_ps(iter, cycled, interior);
+					alive &= ~cycled;
+				}
+				if (k + 1 == next_save)
+				{
+					saved_x = px;
+					saved_y = py;
+					next_save *= 2;
+				}
+			}
+		}
+		_mm512_storeu_si512(out + i, _mm512_cvttps_epi32(iter));
+		if (mag)
+		{
+			_mm512_storeu_ps(mag + i, exit_mag);
+		}
+		if (z_re)
+		{
+			const __m512d lo = _mm512_cvtps_pd(_mm512_castps512_ps256(px));
+			const __m512d hi = _mm512_cvtps_pd(_mm256_castpd_ps(
+				_mm512_extractf64x4_pd(_mm512_castps_pd(px), 1)));
+			_mm512_storeu_pd(z_re + i, lo);
+			_mm512_storeu_pd(z_re + i + 8, hi);
+			const __m512d lo_im = _mm512_cvtps_pd(_mm512_castps512_ps256(py));
+			const __m512d hi_im = _mm512_cvtps_pd(_mm256_castpd_ps(
+				_mm512_extractf64x4_pd(_mm512_castps_pd(py), 1)));
+			_mm512_storeu_pd(z_im + i, lo_im);
+			_mm512_storeu_pd(z_im + i + 8, hi_im);
+		}
+	}
+	_mm256_zeroupper();
+	return cycles + row_scalar_f(p, re + i, im + i, count - i, out + i,
+								 mag ? mag + i : NULL, z_re ? z_re + i : NULL,
+								 z_im ? z_im + i : NULL);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  SPECIALIZED KERNELS OF THE OTHER FORMULAS AND POWERS
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The formula and the power are constants of every kernel below. The steps
+ * are inlined into each of them and the constants fold away, so every loop
+ * is straight-line code without pow() or a test of the formula. The pixels
+ * go one at a time in double, z^2 of julia and mandelbrot has the vector
+ * kernels above. The orbit starts from the pixel as in them, with the step
+ * from z = 0 counted for mandelbrot and burning ship, which folds z to the
+ * first quadrant before every power. Only z^2 of julia and mandelbrot has a
+ * vector path, the other powers and burning ship are scalar.
+ */
+
+/* Z <- Z * W */
+static inline __attribute__((always_inline)) void
+mul(double *x, double *y, double wx, double wy)
+{
+	const double temp = *x * wx - *y * wy;
+	*y = *x * wy + *y * wx;
+	*x = temp;
+}
+
+/* Z <- Z^2 */
+static inline __attribute__((always_inline)) void sqr(double *x, double *y)
+{
+	const double temp = *x * *x - *y * *y;
+	*y = 2 * *x * *y;
+	*x = temp;
+}
+
+/* Z <- Z^D BY SQUARING, THE SWITCH GOES AWAY WITH THE CONSTANT D */
+static inline __attribute__((always_inline)) void
+to_power(int d, double *x, double *y)
+{
+	const double zx = *x, zy = *y;
+	switch (d)
+	{
+	case 2:
+		sqr(x, y);
+		break;
+	case 3:
+		sqr(x, y);
+		mul(x, y, zx, zy);
+		break;
+	case 4:
+		sqr(x, y);
+		sqr(x, y);
+		break;
+	case 5:
+		sqr(x, y);
+		sqr(x, y);
+		mul(x, y, zx, zy);
+		break;
+	case 6:
+		sqr(x, y);
+		mul(x, y, zx, zy);
+		sqr(x, y);
+		break;
+	case 7:
+		sqr(x, y);
+		mul(x, y, zx, zy);
+		sqr(x, y);
+		mul(x, y, zx, zy);
+		break;
+	default:
+		sqr(x, y);
+		sqr(x, y);
+		sqr(x, y);
+		break;
+	}
+}
+
+/* THE SAME AS ROW_SCALAR() FOR THE FORMULA AND THE POWER GIVEN AS CONSTANTS */
+static inline __attribute__((always_inline)) int
+row_formula(const kernel_params *p, const double *re, const double *im,
+			int count, uint32_t *out, float *mag, double *z_re, double *z_im,
+			int formula, int power)
+{
+	const uint32_t first = formula != FORMULA_JULIA; // from z = 0 to z = c
+	int cycles = 0;
+	for (int i = 0; i < count; i++)
+	{
+		double px = re[i], py = im[i];
+		const double cr = formula == FORMULA_JULIA ? p->c_re : px;
+		const double ci = formula == FORMULA_JULIA ? p->c_im : py;
+		double saved_x = px, saved_y = py;
+		double exit_mag = 0;
+		uint32_t ret = first, next_save = first + 1;
+		while (ret <= p->max_iteration)
+		{
+			const double mag2 = px * px + py * py;
+			if (!(mag2 < 4))
+			{
+				exit_mag = mag2;
+				break;
+			}
+			if (formula == FORMULA_BURNING_SHIP)
+			{
+				px = fabs(px);
+				py = fabs(py);
+			}
+			to_power(power, &px, &py);
+			px += cr;
+			py += ci;
+			ret++;
+			if (!p->periodicity)
+			{
+				continue;
+			}
+			const double dx = px - saved_x, dy = py - saved_y;
+			if (dx * dx + dy * dy < PERIODICITY_EPS)
+			{
+				ret = p->max_iteration + 1;
+				cycles++;
+				break;
+			}
+			if (ret == next_save)
+			{
+				saved_x = px;
+				saved_y = py;
+				next_save *= 2;
+			}
+		}
+		out[i] = ret;
+		if (mag)
+		{
+			mag[i] = exit_mag;
+		}
+		if (z_re)
+		{
+			z_re[i] = px;
+			z_im[i] = py;
+		}
+	}
+	return cycles;
+}
+
+/* ONE KERNEL OF THE FAMILY WITH ITS CONSTANTS */
+#define FORMULA_KERNEL(name, formula, power)                                   \
+	static int name(const kernel_params *p, const double *re,                  \
+					const double *im, int count, uint32_t *out, float *mag,    \
+					double *z_re, double *z_im)                                \
+	{                                                                          \
+		return row_formula(p, re, im, count, out, mag, z_re, z_im, formula,    \
+						   power);                                             \
+	}
+
+/* THE KERNELS OF THE POWERS ABOVE 2 */
+#define FORMULA_POWERS(name, formula)                                          \
+	FORMULA_KERNEL(name##_3, formula, 3)                                       \
+	FORMULA_KERNEL(name##_4, formula, 4)                                       \
+	FORMULA_KERNEL(name##_5, formula, 5)                                       \
+	FORMULA_KERNEL(name##_6, formula, 6)                                       \
+	FORMULA_KERNEL(name##_7, formula, 7)                                       \
+	FORMULA_KERNEL(name##_8, formula, 8)
+
+#define POWERS_OF(name)                                                        \
+	[3] = name##_3, [4] = name##_4, [5] = name##_5, [6] = name##_6,            \
+	[7] = name##_7, [8] = name##_8
+
+FORMULA_POWERS(row_julia, FORMULA_JULIA)
+FORMULA_POWERS(row_mandelbrot, FORMULA_MANDELBROT)
+FORMULA_POWERS(row_burning_ship, FORMULA_BURNING_SHIP)
+FORMULA_KERNEL(row_burning_ship_2, FORMULA_BURNING_SHIP, 2)
+
+/* KERNEL OF EVERY FORMULA AND POWER, NULL FOR THOSE OF THE VECTOR KERNELS */
+static const row_function formulas[FORMULA_NBR][MAX_POWER + 1] = {
+	[FORMULA_JULIA] = {POWERS_OF(row_julia)},
+	[FORMULA_MANDELBROT] = {POWERS_OF(row_mandelbrot)},
+	[FORMULA_BURNING_SHIP] = {[2] = row_burning_ship_2,
+							  POWERS_OF(row_burning_ship)},
+};
+
+/* RETURN THE SPECIALIZED KERNEL, NULL IF THE VECTOR KERNELS ITERATE IT */
+static row_function formula_kernel(int formula, int power)
+{
+	const bool known = formula >= 0 && formula < FORMULA_NBR &&
+					   power >= MIN_POWER && power <= MAX_POWER;
+	return known ? formulas[formula][power] : NULL;
+}
@@ -0,0 +1,45 @@
+///////////////////////////////////////////////////////////////////////////////
+//  VECTORIZED ESCAPE TIME KERNELS SELECTED AT RUNTIME
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __KERNEL_H__
+#define __KERNEL_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MIN_POWER 2 // powers d of z^d + c with their own kernels
+#define MAX_POWER 8
+
+/* ITERATED FORMULAS, ALL BUT JULIA TAKE THE PIXEL AS THE CONSTANT */
+enum
+{
+	FORMULA_JULIA,		  // z^d + c
+	FORMULA_MANDELBROT,	  // z^d + pixel
+	FORMULA_BURNING_SHIP, // (|re z| + i |im z|)^d + pixel
+	FORMULA_NBR
+};
+
+/* PARAMETERS SHARED BY ALL PIXELS OF ONE RENDERING */
+typedef struct
+{
+	double c_re;			// constant in real axis
+	double c_im;			// constant in imaginary axis
+	uint32_t max_iteration; // number of iterations
+	bool periodicity;		// stop the orbits which fell into a cycle
+	bool single;			// iterate in float with twice the lanes
+	int formula;			// FORMULA_JULIA, FORMULA_MANDELBROT...
+	int power;				// d of z^d, MIN_POWER to MAX_POWER
+} kernel_params;
+
+void kernel_init(void);
+const char *kernel_name(void);
+int kernel_lanes(void);
+bool kernel_single(int formula, int power);
+int kernel_points(const kernel_params *p, const double *re, const double *im,
+				  int count, uint32_t *out, float *mag, double *z_re,
+				  double *z_im);
+int kernel_row(const kernel_params *p, const double *re, double im,
+			   int count, uint32_t *out, float *mag, double *z_re, double *z_im);
+
+#endif
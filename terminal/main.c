@@ -9,20 +9,30 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <termios.h>
 #include <unistd.h>
 
+#include "animation.h"
+#include "batch.h"
 #include "event_queue.h"
 #include "message.h"
 #include "serial_nonblock.h"
+#include "server.h"
 #include "my_functions.h"
 #include "computation.h"
 #include "gui.h"
-#include "xwin_sdl.h"
+#include "kernel.h"
+#include "thread_pool.h"
+#include "tile_cache.h"
+#include "video.h"
+#include "writer.h"
 
 #define SERIAL_TIMEOUT 500 // timeout for reading from serial port
 #define EXIT_SUCCESS 0
 #define ANIMATION_FRAMES 500 //number of frames in animation
+#define ANIMATION_FPS 60     // rate the presenter shows the frames at
+#define PAN_FRACTION 8       // the arrows move the view by this part of it
 
 ///////////////////////////////////////////////////////////////////////////////
 //  DECLARATION
@@ -34,6 +44,10 @@ typedef struct
    int fd;          // file descriptor
    bool save_im;    // check whether the image will be saved or not
    char user_input; // input character to control the gui settings
+   bool deepen_idle;    // keep raising the iterations while nothing happens
+   bool deepen_pending; // an idle deepening step is waiting in the queue
+   msg_version firmware; // version reported by Nucleo
+   bool firmware_known;  // the version has been received since the startup
 } data_t;
 
 void call_termios(int reset);
@@ -41,16 +55,34 @@ void *boss_thread(void *);
 void *input_thread(void *);
 void *serial_rx_thread(void *); // serial receive buffer
 bool send_message(int fd, message *msg);
+bool touches_view(event_type type);
+void animation_done(int run);
+void show_frame(unsigned char *img);
+void close_video(void);
 
 ///////////////////////////////////////////////////////////////////////////////
 //  MAIN
 ///////////////////////////////////////////////////////////////////////////////
 int main(int argc, char *argv[])
 {
+   /* RENDER THE JOB FILE WITHOUT THE DEVICE, THE TERMINAL AND THE WINDOW */
+   if (argc > 2 && !strcmp(argv[1], "--batch"))
+   {
+      return batch_run(argv[2]) ? EXIT_SUCCESS : 1;
+   }
+   /* SERVE THE TILES TO THE LOCAL PROCESSES, HEADLESS AS WELL */
+   if (argc > 2 && !strcmp(argv[1], "--serve"))
+   {
+      return server_run(argv[2]) ? EXIT_SUCCESS : 1;
+   }
+
    const char *serial = argc > 1 ? argv[1] : "/dev/ttyACM0";
    data_t data;
    data.fd = serial_open(serial);
    data.save_im = true;
+   data.deepen_idle = false;
+   data.deepen_pending = false;
+   data.firmware_known = false;
 
    if (data.fd == -1)
    {
@@ -125,8 +157,8 @@ int main(int argc, char *argv[])
    for (int i = 0; i < NUM_THREADS; ++i)
    {
       int check = pthread_create(&threads[i], NULL, thr_functions[i], &data);
-      fprintf(stderr, "\033[1;34mINFO:\033[0m   %s Thread start: %s\n",
-              thread_names[i], check ? "FAIL" : "\033[1;92mOK\033[0m");
+      INFOF("%s Thread start: %s\n", thread_names[i],
+            check ? "FAIL" : "\033[1;92mOK\033[0m");
       if (check == true)
       {
          ERROR("Fatal error occured, quiting.");
@@ -138,14 +170,19 @@ int main(int argc, char *argv[])
    for (int i = 0; i < NUM_THREADS; i++)
    {
       int check = pthread_join(threads[i], NULL);
-      fprintf(stderr, "\033[1;34mINFO:\033[0m   %s Thread joined: %s\n",
-              thread_names[i], check ? "FAIL" : "\033[1;92mOK\033[0m");
+      INFOF("%s Thread joined: %s\n", thread_names[i],
+            check ? "FAIL" : "\033[1;92mOK\033[0m");
    }
 
    /* RESTORE EVERYTHING TO DEFAULT */
+   anim_finish(true); // quit in the middle of the animation
+   close_video();
+   writer_cleanup(); // the queued images are written first
    queue_cleanup(); // cleanup all events and allocated memory for messages
    gui_cleanup();
    computation_cleanup();
+   pool_cleanup();
+   cache_cleanup(); // the tiles outlive the grids, freed only here
    serial_close(data.fd);
    call_termios(1); // cooked mode - restore terminal settings
    return EXIT_SUCCESS;
@@ -164,8 +201,13 @@ void *boss_thread(void *d)
    msg.data.set_compute.c_re = -0.4;
    msg.data.set_compute.c_im = 0.6;
    queue_init();
+   kernel_init();
+   pool_init(sysconf(_SC_NPROCESSORS_ONLN)); // for the whole process
    computation_init(); //HERE
    gui_init();
+   writer_init();
+   event version = {.source = EV_KEYBOARD, .type = EV_GET_VERSION};
+   queue_push(version); // the wire format of n depends on the firmware
    while (!is_quit())
    {
       event ev = queue_pop();
@@ -176,6 +218,18 @@ void *boss_thread(void *d)
       if (ev.source == EV_KEYBOARD)
       {
          msg.type = MSG_NBR;
+         if (anim_running() && touches_view(ev.type))
+         {
+            if (ev.type == EV_DEEPEN && ev.data.param) // resumed afterwards
+            {
+               data->deepen_pending = false;
+            }
+            else
+            {
+               WARN("Wait for the animation or press 'a' to stop it\n");
+            }
+            continue;
+         }
          switch (ev.type)
          {
 
@@ -187,27 +241,67 @@ void *boss_thread(void *d)
          }
 
          case EV_SET_COMPUTE:
-            if (number_of_chunks() > 255)
+            if (!is_nucleo_formula())
+            {
+               WARN("Nucleo computes only the julia set of z^2 + c, "
+                    "press 'c' to compute on PC\n");
+            }
+            else if (number_of_chunks() > 255)
             {
                WARN("The number of chunks ");
                fprintf(stderr, "%d will overflow 8-bit integer!\n",
                        number_of_chunks());
             }
+            else if (!data->firmware_known)
+            {
+               WARN("The Nucleo firmware version is not known yet, "
+                    "press 'g' and then 's' again\n");
+            }
+            else if (!is_wide_n(&data->firmware) &&
+                     max_iterations() > NARROW_N_MAX)
+            {
+               WARN("The Nucleo firmware before 1.2.0 takes n ");
+               fprintf(stderr, "up to %d, lower it or update Nucleo.bin\n",
+                       NARROW_N_MAX);
+            }
             else
             {
+               msg.data.set_compute.narrow = !is_wide_n(&data->firmware);
                set_compute(&msg)
-                   ? fprintf(stderr, "\033[1;34mINFO:\033[0m   Set new "
-                                     "computation resolution %dx%d no. of "
-                                     "chunks: %d\n",
-                             grid_width(), grid_height(), number_of_chunks())
+                   ? INFOF("Set new computation resolution %dx%d no. of "
+                           "chunks: %d\n",
+                           grid_width(), grid_height(), number_of_chunks())
                    : WARN("New set up discarded due on ongoing computation\n");
             }
             break;
 
          case EV_COMPUTE:
+            if (!is_nucleo_formula())
+            {
+               WARN("Nucleo computes only the julia set of z^2 + c, "
+                    "press 'c' to compute on PC\n");
+               break;
+            }
             enable_comp();
             compute(&msg);
-            if (msg.data.compute.cid == 0)
+            if (msg.type != MSG_COMPUTE && is_done()) // rest was mirrored
+            {
+               gui_refresh();
+               INFO("The remaining chunks were mirrored or reused, "
+                    "jolly good\n");
+               INFO("Tile cache ");
+               fprintf(stderr, "%d hits, %d misses\n", cached_tiles(),
+                       missed_tiles());
+               if (data->save_im)
+               {
+                  gui_save();
+               }
+               else
+               {
+                  INFO("Downloading is disabled, image was not saved\n");
+               }
+            }
+            else if (msg.data.compute.cid == 0)
             {
                INFO("New computation started for part ");
                fprintf(stderr, "%d x %d\n",
@@ -226,7 +320,14 @@ void *boss_thread(void *d)
             break;
 
          case EV_ABORT:
-            if (is_computing())
+            if (anim_running())
+            {
+               anim_finish(true);
+               INFO("The animation was stopped at frame ");
+               fprintf(stderr, "%d of %d\n", anim_shown(), ANIMATION_FRAMES);
+               close_video();
+            }
+            else if (is_computing())
             {
                msg.type = MSG_ABORT;
                INFO("Abort request received, waiting for Nucleo response\n");
@@ -260,14 +361,62 @@ void *boss_thread(void *d)
             break;
 
          case EV_CPU:
-            compute_cpu();
+         {
+            const double start = get_time_ms();
+            compute_cpu(gui_refresh); // coarse passes shown on the way
+            const double end = get_time_ms();
             gui_refresh();
-            INFO("The CPU computation is done, jolly good\n");
+            INFOF("The CPU computation is done in %.1f ms on %d threads, "
+                  "jolly good\n",
+                  end - start, pool_threads());
+            INFO("Computed in ");
+            fprintf(stderr, "%s precision\n", precision_name());
+            if (refined_pixels() > 0)
+            {
+               INFO("Mixed precision pass recomputed ");
+               fprintf(stderr, "%d band edge pixels in double\n",
+                       refined_pixels());
+            }
+            if (is_periodicity())
+            {
+               INFO("Periodicity check stopped ");
+               fprintf(stderr, "%d interior pixels early\n",
+                       periodicity_exits());
+            }
+            if (is_subdivision())
+            {
+               INFO("Rectangle subdivision iterated ");
+               fprintf(stderr, "%d of %d pixels\n", computed_pixels(),
+                       grid_width() * grid_height());
+            }
+            if (is_deep_zoom())
+            {
+               INFO("Deep zoom reference orbit has ");
+               fprintf(stderr, "%d points, %d pixels rebased\n",
+                       reference_length(), rebased_pixels());
+            }
+            if (is_distance())
+            {
+               INFO("Distance estimation supersampled ");
+               fprintf(stderr, "%d boundary pixels\n", supersampled_pixels());
+            }
+            if (mirrored_pixels() > 0)
+            {
+               INFO("Symmetry mirrored ");
+               fprintf(stderr, "%d pixels\n", mirrored_pixels());
+            }
+            if (reused_pixels() > 0)
+            {
+               INFO("Pan or zoom kept ");
+               fprintf(stderr, "%d pixels of the previous view\n",
+                       reused_pixels());
+            }
+            INFO("Tile cache ");
+            fprintf(stderr, "%d hits, %d misses\n", cached_tiles(),
+                    missed_tiles());
             if (data->save_im)
             {
-               save_image_png();
-               save_image_jpg();
-               save_image_bmp();
+               gui_save();
             }
             else
             {
@@ -277,6 +426,7 @@ void *boss_thread(void *d)
             abort_comp();
             INFO("Reseting Nucleo to default state\n");
             break;
+         }
 
          case EV_ANIMATE:;
             if (is_computing())
@@ -285,33 +435,60 @@ void *boss_thread(void *d)
             }
             else
             {
-               INFO("The animation started, enjoy!\n");
-               set_up_animation(&msg.data.set_compute, ANIMATION_FRAMES);
-               for (int i = 0; i < ANIMATION_FRAMES; i++)
-               {
-                  animate();
-                  compute_cpu();
-                  gui_refresh();
-               }
-               INFO("The animation is done, press 'm' to repeat\n");
-               if (data->save_im)
+               // the frames go to the video file as well if it is set
+               if (video_open(getenv("FRACTAL_VIDEO"), grid_width(),
+                              grid_height(), ANIMATION_FPS))
                {
-                  save_image_png();
-                  save_image_jpg();
-                  save_image_bmp();
-               }
-               else
-               {
-                  INFO("Downloading is disabled, image was not saved\n");
+                  INFO("Recording the animation to ");
+                  fprintf(stderr, "%s\n", getenv("FRACTAL_VIDEO"));
                }
+               anim_start(ANIMATION_FRAMES, ANIMATION_FPS, show_frame,
+                          animation_done);
+               INFO("The animation started on ");
+               fprintf(stderr, "%d threads, enjoy!\n", pool_threads());
             }
             break;
 
+         case EV_ANIMATION_DONE:
+         {
+            if (!anim_running() || ev.data.param != anim_run())
+            {
+               break; // stale, its animation was already finished
+            }
+            anim_finish(false);
+            close_video();
+            compute_cpu(NULL); // the grid gets the last frame for 'p' and saving
+            gui_refresh();
+            INFO("The animation is done, press 'm' to repeat\n");
+            if (data->save_im)
+            {
+               gui_save();
+            }
+            else
+            {
+               INFO("Downloading is disabled, image was not saved\n");
+            }
+            if (data->deepen_idle && !data->deepen_pending) // it was paused
+            {
+               event next = {.source = EV_KEYBOARD, .type = EV_DEEPEN};
+               next.data.param = 1;
+               data->deepen_pending = true;
+               queue_push(next);
+            }
+            break;
+         }
+
          case EV_INCREASE:
             increase_parameter(&msg.data.set_compute);
             INFO("Parameter increased to value ");
             fprintf(stderr, "%+-1.1f %+-1.1fi\n", msg.data.set_compute.c_re,
                     msg.data.set_compute.c_im);
+            if (is_progressive() && !queue_has(EV_INCREASE) &&
+                !queue_has(EV_DECREASE)) // a newer step renders it instead
+            {
+               compute_cpu(gui_refresh);
+               gui_refresh();
+            }
             break;
 
          case EV_DECREASE:
@@ -319,6 +496,97 @@ void *boss_thread(void *d)
             INFO("Parameter decreased to value ");
             fprintf(stderr, "%+-1.1f %+-1.1fi\n", msg.data.set_compute.c_re,
                     msg.data.set_compute.c_im);
+            if (is_progressive() && !queue_has(EV_INCREASE) &&
+                !queue_has(EV_DECREASE)) // a newer step renders it instead
+            {
+               compute_cpu(gui_refresh);
+               gui_refresh();
+            }
+            break;
+
+         case EV_ZOOM_IN:
+         case EV_ZOOM_OUT:
+            if (zoom_view(ev.type == EV_ZOOM_IN ? 2 : 0.5))
+            {
+               INFO("View zoomed, pixel size is ");
+               fprintf(stderr, "%.3e, press 'c' to compute\n", pixel_size());
+            }
+            else
+            {
+               WARN("The zoom limit was reached\n");
+            }
+            break;
+
+         case EV_PAN:
+         {
+            const int step_x = grid_width() / PAN_FRACTION;
+            const int step_y = grid_height() / PAN_FRACTION;
+            pan_view(ev.data.param == 'C' ? step_x
+                     : ev.data.param == 'D' ? -step_x
+                                            : 0,
+                     ev.data.param == 'B' ? step_y
+                     : ev.data.param == 'A' ? -step_y
+                                            : 0);
+            INFO("View panned, press 'c' or '1' to compute the new strip\n");
+            break;
+         }
+
+         case EV_DEEPEN:
+         {
+            if (ev.data.param) // a step of the idle chain
+            {
+               data->deepen_pending = false;
+               if (!data->deepen_idle || is_computing())
+               {
+                  break;
+               }
+            }
+            if (!deepen_iterations())
+            {
+               WARN("The iteration limit was reached\n");
+               data->deepen_idle = false;
+               break;
+            }
+            const double start = get_time_ms();
+            compute_cpu(NULL); // the shown pixels are continued, no preview
+            const double end = get_time_ms();
+            gui_refresh();
+            INFO("Iterations raised to ");
+            fprintf(stderr, "%d in %.1f ms\n", max_iterations(), end - start);
+            if (resumed_pixels() > 0)
+            {
+               INFO("Deepening continued ");
+               fprintf(stderr, "%d orbits from n = %d, %d escaped\n",
+                       resumed_pixels(), resumed_iterations(),
+                       escaped_pixels());
+            }
+            // nothing escaped any more, a deeper step would not change it
+            if (resumed_pixels() > 0 && escaped_pixels() == 0)
+            {
+               INFO("Idle deepening stopped, the interior is settled\n");
+               data->deepen_idle = false;
+            }
+            if (data->deepen_idle && !data->deepen_pending)
+            {
+               event next = {.source = EV_KEYBOARD, .type = EV_DEEPEN};
+               next.data.param = 1; // behind the events already queued
+               data->deepen_pending = true;
+               queue_push(next);
+            }
+            break;
+         }
+
+         case EV_IDLE_DEEPEN:
+            data->deepen_idle = !data->deepen_idle;
+            INFO("Idle deepening ");
+            fprintf(stderr, "%s\n", data->deepen_idle ? "on" : "off");
+            if (data->deepen_idle && !data->deepen_pending)
+            {
+               event next = {.source = EV_KEYBOARD, .type = EV_DEEPEN};
+               next.data.param = 1;
+               data->deepen_pending = true;
+               queue_push(next);
+            }
             break;
 
          case EV_CLEAR_GRID:
@@ -363,10 +631,15 @@ void *boss_thread(void *d)
                str[STARTUP_MSG_LEN] = '\0';
                INFO("Nucleo wish you a beatiful day ");
                fprintf(stderr, "%s\n", str);
+               data->firmware_known = false; // it may have been flashed
+               event version = {.source = EV_KEYBOARD, .type = EV_GET_VERSION};
+               queue_push(version);
                break;
             }
 
             case MSG_VERSION:
+               data->firmware = msg->data.version;
+               data->firmware_known = true;
                if (msg->data.version.patch > 0)
                {
                   INFO("Nucleo firmware ver. ");
@@ -389,11 +662,12 @@ void *boss_thread(void *d)
                if (is_done())
                {
                   INFO("Nucleo reports the computation is done, jolly good\n");
+                  INFO("Tile cache ");
+                  fprintf(stderr, "%d hits, %d misses\n", cached_tiles(),
+                          missed_tiles());
                   if (data->save_im)
                   {
-                     save_image_png();
-                     save_image_jpg();
-                     save_image_bmp();
+                     gui_save();
                   }
                   else
                   {
@@ -422,9 +696,11 @@ void *boss_thread(void *d)
                break;
 
             case MSG_COMPUTE_DATA:
+            case MSG_COMPUTE_DATA_WIDE:
                if (!is_abort())
                {
                   update_data(&(msg->data.compute_data));
+                  gui_update(); // the pixels show up while they stream in
                }
                break;
 
@@ -455,6 +731,42 @@ void *boss_thread(void *d)
 //  1 KEYBOARD INPUT
 ///////////////////////////////////////////////////////////////////////////////
 
+/* RETURN TRUE FOR THE EVENTS WHICH CHANGE THE VIEW OR DRAW THE GRID */
+bool touches_view(event_type type)
+{
+   return type == EV_SET_COMPUTE || type == EV_COMPUTE || type == EV_CPU ||
+          type == EV_INCREASE || type == EV_DECREASE || type == EV_ANIMATE ||
+          type == EV_CLEAR_GRID || type == EV_UPDATE_GRID ||
+          type == EV_ZOOM_IN || type == EV_ZOOM_OUT || type == EV_PAN ||
+          type == EV_DEEPEN || type == EV_IDLE_DEEPEN;
+}
+
+/* SHOW THE ANIMATION FRAME AND QUEUE IT FOR THE VIDEO, PRESENTER THREAD */
+void show_frame(unsigned char *img)
+{
+   gui_show(img);
+   video_frame(img);
+}
+
+/* FINISH THE VIDEO OF THE ANIMATION IF ONE IS RECORDED */
+void close_video(void)
+{
+   if (video_recording())
+   {
+      const int frames = video_close();
+      INFO("The video has ");
+      fprintf(stderr, "%d frames\n", frames);
+   }
+}
+
+/* CALLED BY THE PRESENTER AFTER THE LAST FRAME, THE BOSS FINISHES IT */
+void animation_done(int run)
+{
+   event ev = {.source = EV_KEYBOARD, .type = EV_ANIMATION_DONE};
+   ev.data.param = run; // the animation may be stopped or restarted meanwhile
+   queue_push(ev);
+}
+
 /*
  * KEYBOARD INPUT -> OUTPUT MESSAGE
  * 'g' -> MSG_GET_VERSION     print the Nucleo firmware version
@@ -468,16 +780,39 @@ void *boss_thread(void *d)
  * 'q' -> quit                quit program, while computing MSG_ABORT is sent
  * '+' -> increase c          increase parameter while copmuting
  * '-' -> decrease c          decrease parameter while copmuting
+ * 'z' -> zoom in             halve the view around its centre
+ * 'x' -> zoom out            double the view around its centre
+ * arrows -> pan              move the view by an eighth, whole pixels
+ * '*' -> deepen              double the iterations, orbits are continued
+ * 'i' -> idle deepening      keep doubling them until the interior settles
  */
 
 /* RECEIVE THE USER INPUT AND SEND THE MESSAGE TO THE QUEUE */
 void *input_thread(void *arg)
 {
    int c;
+   int escape = 0; // bytes of the arrow sequence ESC [ read so far
    event ev = {.source = EV_KEYBOARD};
    while (!is_quit() && (c = getchar()))
    {
       ev.type = EV_TYPE_NUM;
+      if (escape == 2) // last byte of ESC [ X, only the arrows pan
+      {
+         escape = 0;
+         if (c >= 'A' && c <= 'D' && !is_computing())
+         {
+            ev.type = EV_PAN;
+            ev.data.param = c;
+            queue_push(ev);
+         }
+         continue;
+      }
+      if (c == '\033' || (escape == 1 && c == '['))
+      {
+         escape = c == '\033' ? 1 : 2;
+         continue;
+      }
+      escape = 0; // a broken sequence, the key is read on its own
       switch (c)
       {
       case 'g': // get version
@@ -530,6 +865,31 @@ void *input_thread(void *arg)
             ev.type = EV_DECREASE;
          }
          break;
+      case 'z': // zoom in if it is not computing
+         if (!is_computing())
+         {
+            ev.type = EV_ZOOM_IN;
+         }
+         break;
+      case 'x': // zoom out if it is not computing
+         if (!is_computing())
+         {
+            ev.type = EV_ZOOM_OUT;
+         }
+         break;
+      case '*': // double the iterations if it is not computing
+         if (!is_computing())
+         {
+            ev.type = EV_DEEPEN;
+            ev.data.param = 0;
+         }
+         break;
+      case 'i': // deepen while idle
+         if (!is_computing())
+         {
+            ev.type = EV_IDLE_DEEPEN;
+         }
+         break;
       default: // discard all other keys
 
          break;
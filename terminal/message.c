@@ -31,7 +31,7 @@ extern "C"
          *len = 2 + 3 * sizeof(uint8_t); // 2 + major, minor, patch
          break;
       case MSG_SET_COMPUTE:
-         *len = 2 + 4 * sizeof(double) + 1; // 2 + 4 * params + n
+         *len = 2 + 4 * sizeof(double) + sizeof(uint32_t); // 2 + 4 * params + n
          break;
       case MSG_COMPUTE:
          *len = 2 + 1 + 2 * sizeof(double) + 2; // 2+cid+2x(re,im)+2(n_re,n_im)
@@ -39,6 +39,9 @@ extern "C"
       case MSG_COMPUTE_DATA:
          *len = 2 + 4; // cid, dx, dy, iter
          break;
+      case MSG_COMPUTE_DATA_WIDE:
+         *len = 2 + 3 + sizeof(uint32_t); // cid, dx, dy, 32-bit iter
+         break;
       default:
          ret = false;
          break;
@@ -84,8 +87,16 @@ extern "C"
          memcpy(&(buf[1 + 1 * sizeof(double)]), &(msg->data.set_compute.c_im), sizeof(double));
          memcpy(&(buf[1 + 2 * sizeof(double)]), &(msg->data.set_compute.d_re), sizeof(double));
          memcpy(&(buf[1 + 3 * sizeof(double)]), &(msg->data.set_compute.d_im), sizeof(double));
-         buf[1 + 4 * sizeof(double)] = msg->data.set_compute.n;
-         *len = 1 + 4 * sizeof(double) + 1;
+         if (msg->data.set_compute.narrow) // firmware before 1.2.0
+         {
+            buf[1 + 4 * sizeof(double)] = msg->data.set_compute.n;
+            *len = 1 + 4 * sizeof(double) + 1;
+         }
+         else
+         {
+            memcpy(&(buf[1 + 4 * sizeof(double)]), &(msg->data.set_compute.n), sizeof(uint32_t));
+            *len = 1 + 4 * sizeof(double) + sizeof(uint32_t);
+         }
          break;
       case MSG_COMPUTE:
          buf[1] = msg->data.compute.cid; // cid
@@ -102,6 +113,13 @@ extern "C"
          buf[4] = msg->data.compute_data.iter;
          *len = 5;
          break;
+      case MSG_COMPUTE_DATA_WIDE:
+         buf[1] = msg->data.compute_data.cid;
+         buf[2] = msg->data.compute_data.i_re;
+         buf[3] = msg->data.compute_data.i_im;
+         memcpy(&(buf[4]), &(msg->data.compute_data.iter), sizeof(uint32_t));
+         *len = 4 + sizeof(uint32_t);
+         break;
       default: // unknown message type
          ret = false;
          break;
@@ -162,7 +180,8 @@ extern "C"
             memcpy(&(msg->data.set_compute.c_im), &(buf[1 + 1 * sizeof(double)]), sizeof(double));
             memcpy(&(msg->data.set_compute.d_re), &(buf[1 + 2 * sizeof(double)]), sizeof(double));
             memcpy(&(msg->data.set_compute.d_im), &(buf[1 + 3 * sizeof(double)]), sizeof(double));
-            msg->data.set_compute.n = buf[1 + 4 * sizeof(double)];
+            memcpy(&(msg->data.set_compute.n), &(buf[1 + 4 * sizeof(double)]), sizeof(uint32_t));
+            msg->data.set_compute.narrow = false;
             break;
          case MSG_COMPUTE: // type + chunk_id + nbr_tasks
             msg->data.compute.cid = buf[1];
@@ -177,6 +196,12 @@ extern "C"
             msg->data.compute_data.i_im = buf[3];
             msg->data.compute_data.iter = buf[4];
             break;
+         case MSG_COMPUTE_DATA_WIDE:
+            msg->data.compute_data.cid = buf[1];
+            msg->data.compute_data.i_re = buf[2];
+            msg->data.compute_data.i_im = buf[3];
+            memcpy(&(msg->data.compute_data.iter), &(buf[4]), sizeof(uint32_t));
+            break;
          default: // unknown message type
             ret = false;
             break;
@@ -185,6 +210,13 @@ extern "C"
       return ret;
    }
 
+   /* TRUE IF THE FIRMWARE VERSION TAKES N OF MSG_SET_COMPUTE IN 4 BYTES */
+   bool is_wide_n(const msg_version *version)
+   {
+      return version->major > WIDE_N_MAJOR ||
+             (version->major == WIDE_N_MAJOR && version->minor >= WIDE_N_MINOR);
+   }
+
 #ifdef __cplusplus
 }
 #endif
@@ -14,21 +14,25 @@ extern "C"
 #include <stdbool.h>
 #include <string.h>
 #define STARTUP_MSG_LEN 9 //magic number
+#define WIDE_N_MAJOR 1   // firmware 1.2.0 takes n in 4 bytes, older in 1 byte
+#define WIDE_N_MINOR 2
+#define NARROW_N_MAX 254 // the largest n of the firmware before 1.2.0
 
    /* TYPES OF MESSAGES */
    typedef enum
    {
-      MSG_OK,           // acknowledge of the received message
-      MSG_ERROR,        // report error on the previously received command
-      MSG_ABORT,        // abort received from user button or from serial port
-      MSG_DONE,         // report that the requested work has been done
-      MSG_GET_VERSION,  // request version of the firmware
-      MSG_VERSION,      // send firmware version as major,minor and patch level
-      MSG_STARTUP,      // startup message up to 8 bytes long sent by nucleo
-      MSG_SET_COMPUTE,  // set computation parameters
-      MSG_COMPUTE,      // request computation (chunk_id, nbr_tasks)
-      MSG_COMPUTE_DATA, // computed result (chunk_id, result)
-      MSG_NBR           // number of messages
+      MSG_OK,                // acknowledge of the received message
+      MSG_ERROR,             // report error on the previously received command
+      MSG_ABORT,             // abort received from user button or from serial port
+      MSG_DONE,              // report that the requested work has been done
+      MSG_GET_VERSION,       // request version of the firmware
+      MSG_VERSION,           // send firmware version as major,minor and patch level
+      MSG_STARTUP,           // startup message up to 8 bytes long sent by nucleo
+      MSG_SET_COMPUTE,       // set computation parameters
+      MSG_COMPUTE,           // request computation (chunk_id, nbr_tasks)
+      MSG_COMPUTE_DATA,      // computed result (chunk_id, result)
+      MSG_COMPUTE_DATA_WIDE, // the same with 32-bit result, n above 254
+      MSG_NBR                // number of messages
    } message_type;
 
    /* MESSAGE VERSION */
@@ -52,7 +56,8 @@ extern "C"
       double c_im; // im (y) part of the c constant in recursive equation
       double d_re; // increment in the x-coords
       double d_im; // increment in the y-coords
-      uint8_t n;   // number of iterations per each pixel
+      uint32_t n;  // number of iterations per each pixel
+      bool narrow; // n is sent in 1 byte to the firmware before 1.2.0
    } msg_set_compute;
 
    /* WE CAN'T CALCULATE THE WHOLE PICTURE AT ONCE, THIS SEND SMALL PARTS */
@@ -68,10 +73,10 @@ extern "C"
    /* COMPUTATION RESULT */
    typedef struct
    {
-      uint8_t cid;  // chunk id
-      uint8_t i_re; // x-coords
-      uint8_t i_im; // y-coords
-      uint8_t iter; // number of iterations
+      uint8_t cid;   // chunk id
+      uint8_t i_re;  // x-coords
+      uint8_t i_im;  // y-coords
+      uint32_t iter; // number of iterations
    } msg_compute_data;
 
    /* MESSAGE ALL IN ONE */
@@ -92,6 +97,7 @@ extern "C"
    bool get_message_size(uint8_t msg_type, int *size);
    bool fill_message_buf(const message *msg, uint8_t *buf, int size, int *len);
    bool parse_message_buf(const uint8_t *buf, int size, message *msg);
+   bool is_wide_n(const msg_version *version);
 
 #ifdef __cplusplus
 }
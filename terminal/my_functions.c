@@ -2,9 +2,11 @@
 //  USER FUNCTIONS
 ///////////////////////////////////////////////////////////////////////////////
 #include "message.h"
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
 /* ADVANCED ASSERT */
@@ -30,6 +32,14 @@ void *my_alloc(size_t size)
 	return ret;
 }
 
+/* RETURN THE MONOTONIC TIME IN MILLISECONDS, USED TO MEASURE THE DURATIONS */
+double get_time_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
 /* SWITCH THE TERMINAL FROM COOKED MODE INTO RAW MODE AN VICE VERSA */
 void call_termios(int reset)
 {
@@ -48,10 +58,20 @@ void call_termios(int reset)
 	}
 }
 
+/* MACRO FOR INFO PRINT WITH THE PRINTF FORMAT */
+void INFOF(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	fprintf(stderr, "\033[1;34mINFO:\033[0m   ");
+	vfprintf(stderr, format, args);
+	va_end(args);
+}
+
 /* MACRO FOR INFO PRINT */
 void INFO(char *msg)
 {
-	fprintf(stderr, "\033[1;34mINFO:\033[0m   %s", msg);
+	INFOF("%s", msg);
 }
 
 /* MACRO FOR WARN PRINT */
@@ -7,10 +7,16 @@
 #include <stdbool.h>
 #include <stdlib.h>
 
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
 void my_assert(bool r, const char *fcname, int line, const char *fname);
 void *my_alloc(size_t size);
+double get_time_ms(void);
 void call_termios(int reset);
 void INFO(const char *str);
+void INFOF(const char *format, ...)
+    __attribute__((format(printf, 1, 2)));
 void WARN(const char *str);
 void ERROR(const char *str);
 void NUCLEO(char *msg);
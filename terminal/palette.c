@@ -0,0 +1,204 @@
+///////////////////////////////////////////////////////////////////////////////
+//  PALETTE OF THE ITERATIONS AND ITS LOOKUP TABLE
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * There are only n + 2 colors of the whole iterations, 0 to the interior
+ * value n + 1, so they are evaluated once into a table of n + 2 words with
+ * the rgb in the low three bytes. Mapping a grid then gathers eight words at
+ * once and shuffles them to the packed rgb. Only the smooth values, which
+ * fall between the iterations, go through the polynomials pixel by pixel.
+ * The window takes 32 bit pixels of its own channel order, their table holds
+ * the words as they are stored, so the colors are only gathered and written.
+ */
+
+#include "palette.h"
+#include "my_functions.h"
+#include <immintrin.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define PALETTE_TABLE_MAX (1 << 20) // entries, a larger n goes pixel by pixel
+
+/* COLOR OF THE VALUE, ITERATIONS OR CONTINUOUS ESCAPE VALUE UP TO N + 1 */
+void palette_color(double value, int n, unsigned char *rgb)
+{
+	const double t = MIN(MAX(value / (n + 1.0), 0), 1);
+	rgb[0] = 9 * (1 - t) * t * t * t * 255;				  //R
+	rgb[1] = 15 * (1 - t) * (1 - t) * t * t * 255;		  //G
+	rgb[2] = 8.5 * (1 - t) * (1 - t) * (1 - t) * t * 255; //B
+}
+
+/* THE RGB AS AN OPAQUE 32 BIT PIXEL OF THE FORMAT */
+uint32_t palette_pixel(const unsigned char *rgb, pixel_format f)
+{
+	return (uint32_t)rgb[0] << f.r | (uint32_t)rgb[1] << f.g |
+		   (uint32_t)rgb[2] << f.b | 0xffu << f.a;
+}
+
+/* ALLOCATE THE TABLE OF THE N + 2 PIXELS, NULL IF IT WOULD BE TOO LARGE */
+uint32_t *palette_pixel_table(int n, pixel_format f)
+{
+	if (n < 0 || n + 2 > PALETTE_TABLE_MAX)
+	{
+		return NULL;
+	}
+	uint32_t *table = my_alloc((n + 2) * sizeof(uint32_t));
+	for (int i = 0; i < n + 2; i++)
+	{
+		unsigned char rgb[3];
+		palette_color(i, n, rgb);
+		table[i] = palette_pixel(rgb, f);
+	}
+	return table;
+}
+
+/* ALLOCATE THE TABLE OF THE N + 2 COLORS WITH THE RGB IN THE LOW BYTES */
+uint32_t *palette_table(int n)
+{
+	return palette_pixel_table(n, (pixel_format){.r = 0, .g = 8, .b = 16, .a = 24});
+}
+
+/* READ THE VALUE I OF THE CELL BYTES WIDE VALUES */
+static inline uint32_t value_at(const void *values, int cell, int i)
+{
+	return cell == 1   ? ((const uint8_t *)values)[i]
+		   : cell == 2 ? ((const uint16_t *)values)[i]
+					   : ((const uint32_t *)values)[i];
+}
+
+/* ONE PIXEL AT A TIME, THE VALUES ABOVE N + 1 HAVE THE INTERIOR COLOR */
+static void map_scalar(const uint32_t *table, int n, const void *values,
+					   int cell, int count, unsigned char *rgb)
+{
+	for (int i = 0; i < count; i++, rgb += 3)
+	{
+		const uint32_t c = table[MIN(value_at(values, cell, i), (uint32_t)n + 1)];
+		rgb[0] = c;
+		rgb[1] = c >> 8;
+		rgb[2] = c >> 16;
+	}
+}
+
+/*
+ * Eight pixels per step, the words are gathered from the table and their
+ * low three bytes packed by one shuffle per half. Every half is stored with
+ * 16 bytes of which the last 4 are overwritten next, so the loop stops 10
+ * pixels before the end and never writes past the rgb of its own pixels.
+ */
+__attribute__((target("avx2"))) static int
+map_avx2(const uint32_t *table, int n, const void *values, int cell,
+		 int count, unsigned char *rgb)
+{
+	const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13,
+										  14, -1, -1, -1, -1, 0, 1, 2, 4, 5, 6,
+										  8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	const __m256i interior = _mm256_set1_epi32(n + 1);
+	int i = 0;
+	for (; i + 10 <= count; i += 8, rgb += 24)
+	{
+		__m256i idx;
+		if (cell == 1)
+		{
+			idx = _mm256_cvtepu8_epi32(
+				_mm_loadl_epi64((const __m128i *)((const uint8_t *)values + i)));
+		}
+		else if (cell == 2)
+		{
+			idx = _mm256_cvtepu16_epi32(
+				_mm_loadu_si128((const __m128i *)((const uint16_t *)values + i)));
+		}
+		else
+		{
+			idx = _mm256_loadu_si256((const __m256i *)((const uint32_t *)values + i));
+		}
+		idx = _mm256_min_epu32(idx, interior);
+		const __m256i words = _mm256_i32gather_epi32((const int *)table, idx, 4);
+		const __m256i packed = _mm256_shuffle_epi8(words, pack);
+		_mm_storeu_si128((__m128i *)rgb, _mm256_castsi256_si128(packed));
+		_mm_storeu_si128((__m128i *)(rgb + 12),
+						 _mm256_extracti128_si256(packed, 1));
+	}
+	_mm256_zeroupper();
+	return i;
+}
+
+/*
+ * Color count values of cell bytes each into the packed rgb through the
+ * table of n, without the table every pixel is evaluated on its own.
+ */
+void palette_map(const uint32_t *table, int n, const void *values, int cell,
+				 int count, unsigned char *rgb)
+{
+	if (!table)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			palette_color(value_at(values, cell, i), n, rgb + 3 * i);
+		}
+		return;
+	}
+	const int done = __builtin_cpu_supports("avx2")
+						 ? map_avx2(table, n, values, cell, count, rgb)
+						 : 0;
+	map_scalar(table, n, (const char *)values + done * cell, cell,
+			   count - done, rgb + 3 * done);
+}
+
+/* EIGHT PIXELS PER STEP, THE GATHERED WORDS ARE STORED AS THEY ARE */
+__attribute__((target("avx2"))) static int
+pixels_avx2(const uint32_t *table, int n, const void *values, int cell,
+			int count, uint32_t *pixels)
+{
+	const __m256i interior = _mm256_set1_epi32(n + 1);
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i idx;
+		if (cell == 1)
+		{
+			idx = _mm256_cvtepu8_epi32(
+				_mm_loadl_epi64((const __m128i *)((const uint8_t *)values + i)));
+		}
+		else if (cell == 2)
+		{
+			idx = _mm256_cvtepu16_epi32(
+				_mm_loadu_si128((const __m128i *)((const uint16_t *)values + i)));
+		}
+		else
+		{
+			idx = _mm256_loadu_si256((const __m256i *)((const uint32_t *)values + i));
+		}
+		idx = _mm256_min_epu32(idx, interior);
+		_mm256_storeu_si256((__m256i *)(pixels + i),
+							_mm256_i32gather_epi32((const int *)table, idx, 4));
+	}
+	_mm256_zeroupper();
+	return i;
+}
+
+/*
+ * Color count values of cell bytes each into the 32 bit pixels through the
+ * table made for n and the format, without it the pixels are evaluated.
+ */
+void palette_pixels(const uint32_t *table, pixel_format f, int n,
+					const void *values, int cell, int count, uint32_t *pixels)
+{
+	if (!table)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			unsigned char rgb[3];
+			palette_color(value_at(values, cell, i), n, rgb);
+			pixels[i] = palette_pixel(rgb, f);
+		}
+		return;
+	}
+	int i = __builtin_cpu_supports("avx2")
+				? pixels_avx2(table, n, values, cell, count, pixels)
+				: 0;
+	for (; i < count; i++)
+	{
+		pixels[i] = table[MIN(value_at(values, cell, i), (uint32_t)n + 1)];
+	}
+}
@@ -0,0 +1,28 @@
+///////////////////////////////////////////////////////////////////////////////
+//  PALETTE OF THE ITERATIONS AND ITS LOOKUP TABLE
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __PALETTE_H__
+#define __PALETTE_H__
+
+#include <stdint.h>
+
+/* BIT OFFSETS OF THE RED, GREEN, BLUE AND ALPHA BYTES OF A 32 BIT PIXEL */
+typedef struct
+{
+	int r;
+	int g;
+	int b;
+	int a; // always set to 0xff, the saved pictures are opaque
+} pixel_format;
+
+void palette_color(double value, int n, unsigned char *rgb);
+uint32_t *palette_table(int n);
+void palette_map(const uint32_t *table, int n, const void *values, int cell,
+				 int count, unsigned char *rgb);
+uint32_t palette_pixel(const unsigned char *rgb, pixel_format f);
+uint32_t *palette_pixel_table(int n, pixel_format f);
+void palette_pixels(const uint32_t *table, pixel_format f, int n,
+					const void *values, int cell, int count, uint32_t *pixels);
+
+#endif
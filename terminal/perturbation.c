@@ -0,0 +1,206 @@
+///////////////////////////////////////////////////////////////////////////////
+//  PERTURBATION THEORY FOR THE DEEP ZOOM
+///////////////////////////////////////////////////////////////////////////////
+
+#include "perturbation.h"
+#include "my_functions.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define ORBIT_CHUNK 4096	// first allocation, doubled while the orbit goes on
+#define ORBIT_MAX (1 << 20) // longer pixels are rebased at the end of the orbit
+
+/*
+ * Only the orbit of the view centre Z is iterated precisely, every pixel
+ * z = Z + delta follows it through delta' = 2 Z delta + delta^2 in doubles.
+ * When |z| < |delta| the delta lost its meaning (glitch), so the pixel is
+ * rebased, z itself becomes the delta against the orbit of the critical
+ * point 0. The same happens when the reference orbit escaped before the pixel
+ * or was cut at ORBIT_MAX points.
+ */
+
+/* ONE STORED ORBIT */
+typedef struct
+{
+	double *re;
+	double *im;
+	int len;  // number of stored points
+	int size; // allocated points
+} orbit_points;
+
+/* REFERENCE ORBITS OF THE CURRENT VIEW */
+static struct
+{
+	orbit_points centre; // orbit of the view centre
+	orbit_points crit;	 // orbit of the critical point, used after rebasing
+} ref = {.centre = {.re = NULL, .im = NULL, .len = 0, .size = 0},
+		 .crit = {.re = NULL, .im = NULL, .len = 0, .size = 0}};
+
+/* EXACT SUM OF TWO DOUBLES */
+dd dd_sum(double a, double b)
+{
+	const double s = a + b;
+	const double v = s - a;
+	return (dd){.hi = s, .lo = (a - (s - v)) + (b - v)};
+}
+
+/* NORMALIZE, VALID ONLY FOR |A| >= |B| */
+static inline dd quick_sum(double a, double b)
+{
+	const double s = a + b;
+	return (dd){.hi = s, .lo = b - (s - a)};
+}
+
+/* ADD A DOUBLE TO THE DOUBLE-DOUBLE */
+dd dd_add_d(dd a, double b)
+{
+	dd s = dd_sum(a.hi, b);
+	return quick_sum(s.hi, s.lo + a.lo);
+}
+
+/* ADD TWO DOUBLE-DOUBLES */
+static inline dd dd_add(dd a, dd b)
+{
+	dd s = dd_sum(a.hi, b.hi);
+	const dd t = dd_sum(a.lo, b.lo);
+	s = quick_sum(s.hi, s.lo + t.hi);
+	return quick_sum(s.hi, s.lo + t.lo);
+}
+
+/* MULTIPLY TWO DOUBLE-DOUBLES */
+static inline dd dd_mul(dd a, dd b)
+{
+	const double p = a.hi * b.hi;
+	const double e = fma(a.hi, b.hi, -p) + (a.hi * b.lo + a.lo * b.hi);
+	return quick_sum(p, e);
+}
+
+/* MAKE ROOM FOR MORE POINTS, UP TO LIMIT, FALSE IF THERE IS NO MEMORY */
+static bool grow(orbit_points *o, int limit)
+{
+	const int size = o->size < limit / 2 ? 2 * o->size : limit;
+	double *re = realloc(o->re, size * sizeof(double));
+	if (re)
+	{
+		o->re = re;
+	}
+	double *im = re ? realloc(o->im, size * sizeof(double)) : NULL;
+	if (!im)
+	{
+		return false; // the old arrays stay valid for the stored points
+	}
+	o->im = im;
+	o->size = size;
+	return true;
+}
+
+/* ITERATE Z -> Z^2 + C IN DOUBLE-DOUBLE, STORE AT MOST LIMIT POINTS */
+static void orbit(dd re, dd im, double c_re, double c_im, int limit,
+				  orbit_points *o)
+{
+	if (!o->re) // the first points are always there for the pixels
+	{
+		o->re = my_alloc(ORBIT_CHUNK * sizeof(double));
+		o->im = my_alloc(ORBIT_CHUNK * sizeof(double));
+		o->size = ORBIT_CHUNK;
+	}
+	o->len = 0;
+	while (true)
+	{
+		if (o->len == o->size && !grow(o, limit))
+		{
+			WARN("Not enough memory for the reference orbit, "
+				 "the pixels beyond it are rebased\n");
+			break;
+		}
+		o->re[o->len] = re.hi;
+		o->im[o->len] = im.hi;
+		o->len++;
+		if (o->len >= limit || re.hi * re.hi + im.hi * im.hi >= 4)
+		{
+			break; // the escaped point is kept, the pixels may still need it
+		}
+		const dd re2 = dd_mul(re, re);
+		const dd im2 = dd_mul(im, im);
+		const dd reim = dd_mul(re, im);
+		re = dd_add_d(dd_add(re2, (dd){.hi = -im2.hi, .lo = -im2.lo}), c_re);
+		im = dd_add_d((dd){.hi = 2 * reim.hi, .lo = 2 * reim.lo}, c_im);
+	}
+}
+
+/* COMPUTE THE ORBITS OF THE CENTRE (RE, IM) AND OF 0, RETURN THE CENTRE ONE */
+int perturbation_reference(const kernel_params *p, dd re, dd im)
+{
+	// one step behind max_iteration, the arrays grow only as far as the
+	// orbits go and a bounded orbit stops at ORBIT_MAX (16 MB per orbit)
+	const int limit = MIN(p->max_iteration + 2, ORBIT_MAX);
+	orbit(re, im, p->c_re, p->c_im, limit, &ref.centre);
+	const dd zero = {.hi = 0, .lo = 0};
+	orbit(zero, zero, p->c_re, p->c_im, limit, &ref.crit);
+	return ref.centre.len;
+}
+
+/* ITERATE THE PIXELS AT OFFSETS (DRE, DIM) FROM THE CENTRE, RETURN REBASED */
+int perturbation_points(const kernel_params *p, const double *dre,
+						const double *dim, int count, uint32_t *out,
+						float *mag)
+{
+	int rebased = 0;
+	for (int i = 0; i < count; i++)
+	{
+		const double *zr = ref.centre.re;
+		const double *zi = ref.centre.im;
+		int len = ref.centre.len;
+		int m = 0; // index in the current reference orbit
+		double x = dre[i];
+		double y = dim[i];
+		bool rebase = false;
+		double exit_mag = 0;
+		uint32_t iter = 0;
+		while (iter <= p->max_iteration)
+		{
+			const double re = zr[m] + x;
+			const double im = zi[m] + y;
+			const double mag2 = re * re + im * im;
+			if (mag2 >= 4)
+			{
+				exit_mag = mag2;
+				break;
+			}
+			if (m + 1 >= len || mag2 < x * x + y * y) // glitch, rebase to 0
+			{
+				x = re;
+				y = im;
+				zr = ref.crit.re;
+				zi = ref.crit.im;
+				len = ref.crit.len;
+				m = 0;
+				rebase = true;
+			}
+			const double t = 2 * (zr[m] * x - zi[m] * y) + x * x - y * y;
+			y = 2 * (zr[m] * y + zi[m] * x) + 2 * x * y;
+			x = t;
+			m++;
+			iter++;
+		}
+		out[i] = iter;
+		if (mag)
+		{
+			mag[i] = exit_mag;
+		}
+		rebased += rebase;
+	}
+	return rebased;
+}
+
+/* FREE THE REFERENCE ORBITS */
+void perturbation_cleanup(void)
+{
+	free(ref.centre.re);
+	free(ref.centre.im);
+	free(ref.crit.re);
+	free(ref.crit.im);
+	ref.centre = ref.crit = (orbit_points){.re = NULL, .im = NULL, .len = 0,
+										   .size = 0};
+}
@@ -0,0 +1,26 @@
+///////////////////////////////////////////////////////////////////////////////
+//  PERTURBATION THEORY FOR THE DEEP ZOOM
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __PERTURBATION_H__
+#define __PERTURBATION_H__
+
+#include "kernel.h"
+#include <stdint.h>
+
+/* DOUBLE-DOUBLE NUMBER, THE VALUE IS HI + LO WITH |LO| <= ULP(HI) / 2 */
+typedef struct
+{
+	double hi;
+	double lo;
+} dd;
+
+dd dd_sum(double a, double b);
+dd dd_add_d(dd a, double b);
+int perturbation_reference(const kernel_params *p, dd re, dd im);
+int perturbation_points(const kernel_params *p, const double *dre,
+						const double *dim, int count, uint32_t *out,
+						float *mag);
+void perturbation_cleanup(void);
+
+#endif
@@ -0,0 +1,517 @@
+///////////////////////////////////////////////////////////////////////////////
+//  LOCAL TILE SERVER OVER A UNIX SOCKET OR LOCALHOST TCP
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * A client sends one request per line and gets the answer before the next:
+ *
+ *    TILE c_re c_im re_min re_max im_min im_max n z x y raw|png
+ *
+ * The view is cut to 2^z x 2^z tiles of 256 x 256 pixels, x goes right and
+ * y down from the upper left one. The answer is "OK w h bytes" and a new
+ * line followed by the bytes, the little endian 32 bit iterations of the
+ * rows for raw, or "ERR reason" alone. Every client has a thread of its own
+ * and renders on the worker pool of the computation. Only a bounded number
+ * of tiles is rendered at once, the others wait, and a request for a tile
+ * already being rendered waits for that one instead of rendering it again.
+ */
+
+#include "server.h"
+#include "computation.h"
+#include "kernel.h"
+#include "my_functions.h"
+#include "thread_pool.h"
+#include "tile_cache.h"
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SERVER_TILE 256		 // edge of a tile in pixels
+#define SERVER_MAX_ZOOM 40	 // deeper tiles are out of the double precision
+#define SERVER_IN_FLIGHT 8	 // tiles rendered at once
+#define SERVER_CLIENTS 64	 // connections served at once
+#define SERVER_LINE 512		 // longest request line
+
+/* TILE ASKED FOR, ZEROED FIRST SO IT CAN BE COMPARED AS BYTES */
+typedef struct
+{
+	view_params view; // the tile alone
+	bool png;
+} tile_request;
+
+/* TILE BEING RENDERED OR SENT, SHARED BY THE SAME REQUESTS */
+typedef struct flight
+{
+	struct flight *next;
+	tile_request key;
+	int waiters; // clients which are going to send it
+	bool done;
+	unsigned char *data;
+	size_t len;
+} flight;
+
+/* STRUCT HOLDING THE SERVER STATE SHARED BY THE CLIENT THREADS */
+static struct
+{
+	pthread_mutex_t mtx;
+	pthread_cond_t cond; // a tile is done or a rendering slot is free
+	flight *flights;
+	int rendering;
+	int clients;
+	int served;
+	int coalesced;
+	volatile sig_atomic_t quit;
+} server = {.mtx = PTHREAD_MUTEX_INITIALIZER,
+			.cond = PTHREAD_COND_INITIALIZER,
+			.flights = NULL,
+			.rendering = 0,
+			.clients = 0,
+			.served = 0,
+			.coalesced = 0,
+			.quit = 0};
+
+static uint32_t crc_table[256];
+
+/* CRC-32 OF THE PNG CHUNKS CONTINUED FROM THE CRC */
+static uint32_t crc32(uint32_t crc, const unsigned char *bytes, size_t len)
+{
+	crc = ~crc;
+	for (size_t i = 0; i < len; i++)
+	{
+		crc = crc_table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+/* STORE THE VALUE IN BIG ENDIAN */
+static void put_be(unsigned char *p, uint32_t value)
+{
+	p[0] = value >> 24;
+	p[1] = value >> 16;
+	p[2] = value >> 8;
+	p[3] = value;
+}
+
+/* APPEND ONE CHUNK OF TYPE AND DATA, RETURN THE POSITION BEHIND IT */
+static unsigned char *png_chunk(unsigned char *p, const char *type,
+								const unsigned char *data, size_t len)
+{
+	put_be(p, len);
+	memcpy(p + 4, type, 4);
+	memmove(p + 8, data, len); // the data may be built in place already
+	put_be(p + 8 + len, crc32(0, p + 4, 4 + len));
+	return p + 12 + len;
+}
+
+/*
+ * Encode the rgb image as png, the zlib stream uses stored blocks only. The
+ * colors of the palette compress poorly anyway and the tile stays fast to
+ * produce, the length of the png is returned.
+ */
+static size_t encode_png(const unsigned char *rgb, int w, int h,
+						 unsigned char **png)
+{
+	const size_t raw = (size_t)h * (1 + 3 * w); // filter byte in every row
+	const size_t blocks = (raw + 65534) / 65535;
+	const size_t zlen = 2 + raw + 5 * blocks + 4;
+	unsigned char *out = my_alloc(8 + 25 + 12 + zlen + 12);
+	memcpy(out, "\x89PNG\r\n\x1a\n", 8);
+	unsigned char ihdr[13] = {0};
+	put_be(ihdr, w);
+	put_be(ihdr + 4, h);
+	ihdr[8] = 8; // bits per channel
+	ihdr[9] = 2; // rgb
+	unsigned char *p = png_chunk(out + 8, "IHDR", ihdr, sizeof(ihdr));
+	unsigned char *z = p + 8; // the zlib stream is built in the chunk
+	unsigned char *q = z;
+	*q++ = 0x78;
+	*q++ = 0x01;
+	uint32_t a = 1, b = 0; // adler-32 of the raw rows
+	size_t left = raw;
+	int y = 0;
+	int x = -1; // -1 is the filter byte of the row
+	while (left > 0)
+	{
+		const size_t len = left < 65535 ? left : 65535;
+		left -= len;
+		*q++ = left == 0; // the last block
+		*q++ = len & 0xff;
+		*q++ = len >> 8;
+		*q++ = ~len & 0xff;
+		*q++ = (~len >> 8) & 0xff;
+		for (size_t i = 0; i < len; i++)
+		{
+			const unsigned char byte = x < 0 ? 0 : rgb[3 * (y * w) + x];
+			*q++ = byte;
+			a = (a + byte) % 65521;
+			b = (b + a) % 65521;
+			if (++x == 3 * w)
+			{
+				x = -1;
+				y++;
+			}
+		}
+	}
+	put_be(q, (b << 16) | a);
+	p = png_chunk(p, "IDAT", z, q + 4 - z);
+	p = png_chunk(p, "IEND", NULL, 0);
+	*png = out;
+	return p - out;
+}
+
+/* READ THE REQUEST LINE INTO THE ZEROED TILE, NULL OR THE ERROR */
+static const char *parse_request(const char *line, tile_request *r)
+{
+	view_params v;
+	int z, x, y;
+	char format[8];
+	memset(r, 0, sizeof(*r));
+	if (sscanf(line, "TILE %lf %lf %lf %lf %lf %lf %d %d %d %d %7s", &v.c_re,
+			   &v.c_im, &v.re_min, &v.re_max, &v.im_min, &v.im_max, &v.n, &z,
+			   &x, &y, format) != 11)
+	{
+		return "malformed request";
+	}
+	if (!(v.re_min < v.re_max && v.im_min < v.im_max) || v.n < 1 || z < 0 ||
+		z > SERVER_MAX_ZOOM || x < 0 || y < 0 || x >= (1LL << z) ||
+		y >= (1LL << z))
+	{
+		return "tile out of range";
+	}
+	if (strcmp(format, "raw") && strcmp(format, "png"))
+	{
+		return "unknown format";
+	}
+	const double tile_re = (v.re_max - v.re_min) / (1LL << z);
+	const double tile_im = (v.im_max - v.im_min) / (1LL << z);
+	r->view.c_re = v.c_re;
+	r->view.c_im = v.c_im;
+	r->view.re_min = v.re_min + x * tile_re;
+	r->view.re_max = r->view.re_min + tile_re;
+	r->view.im_max = v.im_max - y * tile_im;
+	r->view.im_min = r->view.im_max - tile_im;
+	r->view.n = v.n;
+	r->view.w = SERVER_TILE;
+	r->view.h = SERVER_TILE;
+	r->png = !strcmp(format, "png");
+	return NULL;
+}
+
+/* RENDER THE TILE TO THE BYTES OF THE ANSWER */
+static void render_request(flight *f)
+{
+	const view_params *v = &f->key.view;
+	const int count = v->w * v->h;
+	uint32_t *values = my_alloc(count * sizeof(uint32_t));
+	render_view(v, values);
+	if (f->key.png)
+	{
+		unsigned char *rgb = my_alloc(3 * count);
+		color_view(values, count, v->n, rgb);
+		f->len = encode_png(rgb, v->w, v->h, &f->data);
+		free(rgb);
+	}
+	else
+	{
+		f->len = count * sizeof(uint32_t);
+		f->data = my_alloc(f->len);
+		for (int i = 0; i < count; i++) // little endian on any host
+		{
+			f->data[4 * i] = values[i];
+			f->data[4 * i + 1] = values[i] >> 8;
+			f->data[4 * i + 2] = values[i] >> 16;
+			f->data[4 * i + 3] = values[i] >> 24;
+		}
+	}
+	free(values);
+}
+
+/* RETURN THE DONE FLIGHT OF THE TILE, NULL IF THE SERVER IS STOPPING */
+static flight *take_flight(const tile_request *r)
+{
+	pthread_mutex_lock(&server.mtx);
+	flight *f;
+	while (true)
+	{
+		if (server.quit)
+		{
+			pthread_mutex_unlock(&server.mtx);
+			return NULL;
+		}
+		for (f = server.flights; f; f = f->next)
+		{
+			if (!memcmp(&f->key, r, sizeof(*r)))
+			{
+				break;
+			}
+		}
+		if (f || server.rendering < SERVER_IN_FLIGHT)
+		{
+			break;
+		}
+		pthread_cond_wait(&server.cond, &server.mtx); // too many at once
+	}
+	if (f) // the same tile is on the way already
+	{
+		f->waiters++;
+		server.coalesced++;
+		while (!f->done)
+		{
+			pthread_cond_wait(&server.cond, &server.mtx);
+		}
+		pthread_mutex_unlock(&server.mtx);
+		return f;
+	}
+	f = my_alloc(sizeof(flight));
+	f->key = *r;
+	f->waiters = 1;
+	f->done = false;
+	f->data = NULL;
+	f->next = server.flights;
+	server.flights = f;
+	server.rendering++;
+	pthread_mutex_unlock(&server.mtx);
+	render_request(f);
+	pthread_mutex_lock(&server.mtx);
+	f->done = true;
+	server.rendering--;
+	pthread_cond_broadcast(&server.cond);
+	pthread_mutex_unlock(&server.mtx);
+	return f;
+}
+
+/* DROP THE FLIGHT, THE LAST CLIENT WHICH SENT IT FREES IT */
+static void release_flight(flight *f)
+{
+	pthread_mutex_lock(&server.mtx);
+	server.served++;
+	if (--f->waiters == 0)
+	{
+		flight **link = &server.flights;
+		while (*link != f)
+		{
+			link = &(*link)->next;
+		}
+		*link = f->next;
+		free(f->data);
+		free(f);
+	}
+	pthread_mutex_unlock(&server.mtx);
+}
+
+/* SEND ALL BYTES, FALSE IF THE CLIENT IS GONE */
+static bool send_all(int fd, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	while (len > 0)
+	{
+		const ssize_t sent = send(fd, p, len, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (sent <= 0)
+		{
+			return false;
+		}
+		p += sent;
+		len -= sent;
+	}
+	return true;
+}
+
+/* ANSWER THE REQUESTS OF ONE CLIENT UNTIL IT CLOSES THE CONNECTION */
+static void *client_thread(void *arg)
+{
+	const int fd = (int)(intptr_t)arg;
+	FILE *in = fdopen(dup(fd), "r");
+	char line[SERVER_LINE];
+	bool ok = in != NULL;
+	while (ok && fgets(line, sizeof(line), in))
+	{
+		char header[64];
+		tile_request r;
+		const char *error = parse_request(line, &r);
+		if (error)
+		{
+			snprintf(header, sizeof(header), "ERR %s\n", error);
+			ok = send_all(fd, header, strlen(header));
+			continue;
+		}
+		flight *f = take_flight(&r);
+		if (!f)
+		{
+			send_all(fd, "ERR stopping\n", 13);
+			break;
+		}
+		snprintf(header, sizeof(header), "OK %d %d %zu\n", r.view.w, r.view.h,
+				 f->len);
+		ok = send_all(fd, header, strlen(header)) &&
+			 send_all(fd, f->data, f->len);
+		release_flight(f);
+	}
+	if (in)
+	{
+		fclose(in);
+	}
+	close(fd);
+	pthread_mutex_lock(&server.mtx);
+	server.clients--;
+	pthread_mutex_unlock(&server.mtx);
+	return NULL;
+}
+
+/* OPEN THE LISTENING SOCKET, A NUMBER IS A LOCALHOST TCP PORT */
+static int listen_on(const char *address, bool *unix_socket)
+{
+	bool port = *address != '\0';
+	for (const char *c = address; *c; c++)
+	{
+		port = port && isdigit((unsigned char)*c);
+	}
+	*unix_socket = !port;
+	int fd;
+	if (port)
+	{
+		struct sockaddr_in addr = {.sin_family = AF_INET,
+								   .sin_port = htons(atoi(address)),
+								   .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		const int yes = 1;
+		if (fd < 0 ||
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) ||
+			bind(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		{
+			return -1;
+		}
+	}
+	else
+	{
+		struct sockaddr_un addr = {.sun_family = AF_UNIX};
+		if (strlen(address) >= sizeof(addr.sun_path))
+		{
+			return -1;
+		}
+		strcpy(addr.sun_path, address);
+		unlink(address); // left behind by a server which was killed
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		{
+			return -1;
+		}
+	}
+	return listen(fd, SERVER_CLIENTS) ? -1 : fd;
+}
+
+/* BLOCK OR RESTORE SIGINT AND SIGTERM, THE NEW THREADS INHERIT THE MASK */
+static void block_signals(bool block, sigset_t *old)
+{
+	if (block)
+	{
+		sigset_t set;
+		sigemptyset(&set);
+		sigaddset(&set, SIGINT);
+		sigaddset(&set, SIGTERM);
+		pthread_sigmask(SIG_BLOCK, &set, old);
+	}
+	else
+	{
+		pthread_sigmask(SIG_SETMASK, old, NULL);
+	}
+}
+
+/* STOP ACCEPTING ON SIGINT AND SIGTERM */
+static void stop_server(int sig)
+{
+	(void)sig;
+	server.quit = 1;
+}
+
+/* SERVE THE TILES ON THE ADDRESS UNTIL SIGINT OR SIGTERM */
+bool server_run(const char *address)
+{
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		uint32_t c = i;
+		for (int k = 0; k < 8; k++)
+		{
+			c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+		}
+		crc_table[i] = c;
+	}
+	bool unix_socket;
+	const int fd = listen_on(address, &unix_socket);
+	if (fd < 0)
+	{
+		ERROR("The server socket can not be opened\n");
+		return false;
+	}
+	// only this thread gets the signals, so they interrupt the accept
+	struct sigaction sa = {.sa_handler = stop_server};
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigset_t old;
+	block_signals(true, &old);
+	kernel_init();
+	pool_init(sysconf(_SC_NPROCESSORS_ONLN)); // the workers keep the mask
+	computation_init();
+	block_signals(false, &old);
+	INFOF("Serving %dx%d tiles on %s\n", SERVER_TILE, SERVER_TILE, address);
+	while (!server.quit)
+	{
+		const int client = accept(fd, NULL, NULL);
+		if (client < 0)
+		{
+			continue; // interrupted by the signal or a client gone already
+		}
+		pthread_mutex_lock(&server.mtx);
+		const bool busy = server.clients >= SERVER_CLIENTS;
+		server.clients += !busy;
+		pthread_mutex_unlock(&server.mtx);
+		pthread_t thread;
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		block_signals(true, &old);
+		const bool failed = busy || pthread_create(&thread, &attr,
+												   client_thread,
+												   (void *)(intptr_t)client);
+		block_signals(false, &old);
+		if (failed)
+		{
+			send_all(client, "ERR busy\n", 9);
+			close(client);
+			pthread_mutex_lock(&server.mtx);
+			server.clients -= !busy;
+			pthread_mutex_unlock(&server.mtx);
+		}
+		pthread_attr_destroy(&attr);
+	}
+	close(fd);
+	if (unix_socket)
+	{
+		unlink(address);
+	}
+	pthread_mutex_lock(&server.mtx);
+	pthread_cond_broadcast(&server.cond); // the waiting clients see the quit
+	while (server.rendering > 0) // the pool is needed until the last tile
+	{
+		pthread_cond_wait(&server.cond, &server.mtx);
+	}
+	INFOF("Served %d tiles, %d of them coalesced\n", server.served,
+		  server.coalesced);
+	pthread_mutex_unlock(&server.mtx);
+	computation_cleanup();
+	pool_cleanup();
+	cache_cleanup();
+	return true;
+}
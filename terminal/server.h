@@ -0,0 +1,12 @@
+///////////////////////////////////////////////////////////////////////////////
+//  LOCAL TILE SERVER OVER A UNIX SOCKET OR LOCALHOST TCP
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include <stdbool.h>
+
+bool server_run(const char *address);
+
+#endif
@@ -0,0 +1,287 @@
+///////////////////////////////////////////////////////////////////////////////
+//  PERSISTENT WORKER POOL WITH WORK STEALING
+///////////////////////////////////////////////////////////////////////////////
+
+#include "thread_pool.h"
+#include "my_functions.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define POOL_MAX_THREADS 64 // upper limit of the worker threads
+#define POOL_DEQUE_SIZE 32	// number of task ranges one worker can hold
+
+/* ONE CALL OF POOL_RUN, SHARED BY ALL RANGES CUT FROM IT */
+typedef struct
+{
+	pool_task fn;  // function called for every task
+	void *arg;	   // argument passed to the function
+	int remaining; // tasks which are not finished yet
+} batch;
+
+/* CONTINUOUS RANGE OF TASKS [FIRST, LAST) OF ONE BATCH */
+typedef struct
+{
+	batch *b;
+	int first;
+	int last;
+} range;
+
+/* RANGES OWNED BY ONE WORKER, THE OWNER TAKES THE NEWEST, THIEVES THE OLDEST */
+typedef struct
+{
+	pthread_mutex_t mtx;
+	range r[POOL_DEQUE_SIZE];
+	int top;	// oldest range
+	int bottom; // one behind the newest range
+} deque;
+
+/* STRUCT HOLDING THE WHOLE POOL */
+static struct
+{
+	int nbr_threads;
+	pthread_t threads[POOL_MAX_THREADS];
+	int ids[POOL_MAX_THREADS];
+	deque deques[POOL_MAX_THREADS];
+	int pending; // tasks pushed to the deques and not taken yet
+	bool quit;
+	pthread_mutex_t mtx;
+	pthread_cond_t work; // signaled when new tasks are pushed
+	pthread_cond_t done; // signaled when some batch is finished
+} pool = {.nbr_threads = 0, .pending = 0, .quit = false};
+
+static void *worker_thread(void *arg);
+
+/* START THE WORKERS, WITH ONE THREAD THE TASKS ARE RUN BY THE CALLER */
+void pool_init(int nbr_threads)
+{
+	nbr_threads = nbr_threads < 1 ? 1 : nbr_threads;
+	nbr_threads = nbr_threads > POOL_MAX_THREADS ? POOL_MAX_THREADS
+												 : nbr_threads;
+	pool.quit = false;
+	pool.pending = 0;
+	pool.nbr_threads = 0;
+	if (pthread_mutex_init(&pool.mtx, NULL) ||
+		pthread_cond_init(&pool.work, NULL) ||
+		pthread_cond_init(&pool.done, NULL))
+	{
+		ERROR("Could not initialize the worker pool.\n");
+		exit(100);
+	}
+	INFOF("Worker pool started with %d threads\n", nbr_threads);
+	if (nbr_threads == 1)
+	{
+		pool.nbr_threads = 1;
+		return;
+	}
+	for (int i = 0; i < nbr_threads; ++i)
+	{
+		deque *d = &pool.deques[i];
+		d->top = d->bottom = 0;
+		pool.ids[i] = i;
+		if (pthread_mutex_init(&d->mtx, NULL) ||
+			pthread_create(&pool.threads[i], NULL, worker_thread, &pool.ids[i]))
+		{
+			ERROR("Could not start the worker thread.\n");
+			exit(100);
+		}
+		pool.nbr_threads++;
+	}
+}
+
+/* STOP AND JOIN ALL WORKERS */
+void pool_cleanup(void)
+{
+	pthread_mutex_lock(&pool.mtx);
+	pool.quit = true;
+	pthread_cond_broadcast(&pool.work);
+	pthread_mutex_unlock(&pool.mtx);
+	if (pool.nbr_threads > 1)
+	{
+		for (int i = 0; i < pool.nbr_threads; ++i)
+		{
+			pthread_join(pool.threads[i], NULL);
+			pthread_mutex_destroy(&pool.deques[i].mtx);
+		}
+	}
+	pool.nbr_threads = 0;
+}
+
+/* RETURN THE NUMBER OF THREADS WHICH EXECUTE THE TASKS */
+int pool_threads(void)
+{
+	return pool.nbr_threads;
+}
+
+/* PUSH THE RANGE TO THE BOTTOM OF THE DEQUE, FALSE IF IT IS FULL */
+static bool deque_push(deque *d, range r)
+{
+	bool ret = false;
+	pthread_mutex_lock(&d->mtx);
+	if (d->bottom - d->top < POOL_DEQUE_SIZE)
+	{
+		d->r[d->bottom % POOL_DEQUE_SIZE] = r;
+		d->bottom++;
+		ret = true;
+	}
+	pthread_mutex_unlock(&d->mtx);
+	return ret;
+}
+
+/* TAKE ONE TASK FROM THE NEWEST RANGE OF OUR OWN DEQUE */
+static bool take_own(deque *d, batch **b, int *task)
+{
+	bool ret = false;
+	pthread_mutex_lock(&d->mtx);
+	if (d->bottom > d->top)
+	{
+		range *r = &d->r[(d->bottom - 1) % POOL_DEQUE_SIZE];
+		*b = r->b;
+		*task = r->first++;
+		if (r->first == r->last)
+		{
+			d->bottom--;
+		}
+		ret = true;
+	}
+	pthread_mutex_unlock(&d->mtx);
+	return ret;
+}
+
+/* STEAL THE UPPER HALF OF THE OLDEST RANGE OF THE VICTIM */
+static bool steal(deque *victim, range *stolen)
+{
+	bool ret = false;
+	pthread_mutex_lock(&victim->mtx);
+	if (victim->bottom > victim->top)
+	{
+		range *r = &victim->r[victim->top % POOL_DEQUE_SIZE];
+		const int half = (r->last - r->first + 1) / 2;
+		stolen->b = r->b;
+		stolen->last = r->last;
+		stolen->first = r->last - half;
+		r->last -= half;
+		if (r->first == r->last)
+		{
+			victim->top++;
+		}
+		ret = true;
+	}
+	pthread_mutex_unlock(&victim->mtx);
+	return ret;
+}
+
+/* MARK ONE TASK OF THE BATCH AS FINISHED */
+static void finish_task(batch *b)
+{
+	if (__atomic_sub_fetch(&b->remaining, 1, __ATOMIC_ACQ_REL) == 0)
+	{
+		pthread_mutex_lock(&pool.mtx);
+		pthread_cond_broadcast(&pool.done);
+		pthread_mutex_unlock(&pool.mtx);
+	}
+}
+
+/* FIND A TASK IN OUR DEQUE OR STEAL IT FROM THE OTHER WORKERS */
+static bool find_task(int id, batch **b, int *task)
+{
+	if (take_own(&pool.deques[id], b, task))
+	{
+		return true;
+	}
+	for (int i = 1; i < pool.nbr_threads; ++i)
+	{
+		range r;
+		if (steal(&pool.deques[(id + i) % pool.nbr_threads], &r))
+		{
+			*b = r.b;
+			*task = r.first++;
+			if (r.first < r.last && !deque_push(&pool.deques[id], r))
+			{
+				while (r.first < r.last) // no space, do it on our own
+				{
+					__atomic_sub_fetch(&pool.pending, 1, __ATOMIC_ACQ_REL);
+					r.b->fn(r.first++, r.b->arg);
+					finish_task(r.b);
+				}
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+/* WORKER LOOP, SLEEPS WHILE THERE IS NOTHING TO DO */
+static void *worker_thread(void *arg)
+{
+	const int id = *(int *)arg;
+	while (true)
+	{
+		batch *b;
+		int task;
+		if (find_task(id, &b, &task))
+		{
+			__atomic_sub_fetch(&pool.pending, 1, __ATOMIC_ACQ_REL);
+			b->fn(task, b->arg);
+			finish_task(b);
+			continue;
+		}
+		pthread_mutex_lock(&pool.mtx);
+		while (!pool.quit &&
+			   __atomic_load_n(&pool.pending, __ATOMIC_ACQUIRE) == 0)
+		{
+			pthread_cond_wait(&pool.work, &pool.mtx);
+		}
+		const bool quit = pool.quit;
+		pthread_mutex_unlock(&pool.mtx);
+		if (quit)
+		{
+			break;
+		}
+	}
+	return NULL;
+}
+
+/* RUN FN FOR TASKS 0..NBR_TASKS-1 ON THE WORKERS AND WAIT UNTIL ALL FINISH */
+void pool_run(int nbr_tasks, pool_task fn, void *arg)
+{
+	if (nbr_tasks <= 0)
+	{
+		return;
+	}
+	if (pool.nbr_threads <= 1)
+	{
+		for (int i = 0; i < nbr_tasks; ++i)
+		{
+			fn(i, arg);
+		}
+		return;
+	}
+	batch b = {.fn = fn, .arg = arg, .remaining = nbr_tasks};
+	const int parts = nbr_tasks < pool.nbr_threads ? nbr_tasks
+												   : pool.nbr_threads;
+	__atomic_add_fetch(&pool.pending, nbr_tasks, __ATOMIC_ACQ_REL);
+	for (int i = 0; i < parts; ++i) // contiguous ranges keep the locality
+	{
+		range r = {.b = &b,
+				   .first = (int)((long)nbr_tasks * i / parts),
+				   .last = (int)((long)nbr_tasks * (i + 1) / parts)};
+		if (!deque_push(&pool.deques[i], r))
+		{
+			while (r.first < r.last) // all deques are full, help the workers
+			{
+				__atomic_sub_fetch(&pool.pending, 1, __ATOMIC_ACQ_REL);
+				fn(r.first++, arg);
+				finish_task(&b);
+			}
+		}
+	}
+	pthread_mutex_lock(&pool.mtx);
+	pthread_cond_broadcast(&pool.work);
+	while (__atomic_load_n(&b.remaining, __ATOMIC_ACQUIRE) > 0)
+	{
+		pthread_cond_wait(&pool.done, &pool.mtx);
+	}
+	pthread_mutex_unlock(&pool.mtx);
+}
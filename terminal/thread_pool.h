@@ -0,0 +1,15 @@
+///////////////////////////////////////////////////////////////////////////////
+//  PERSISTENT WORKER POOL WITH WORK STEALING
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+typedef void (*pool_task)(int task, void *arg);
+
+void pool_init(int nbr_threads);
+void pool_cleanup(void);
+int pool_threads(void);
+void pool_run(int nbr_tasks, pool_task fn, void *arg);
+
+#endif
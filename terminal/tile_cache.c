@@ -0,0 +1,242 @@
+///////////////////////////////////////////////////////////////////////////////
+//  LEAST RECENTLY USED CACHE OF THE COMPUTED TILES
+///////////////////////////////////////////////////////////////////////////////
+
+#include "tile_cache.h"
+#include "my_functions.h"
+#include "tile_store.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_BUCKETS 256 // initial size of the hash table, doubled when full
+
+/* ONE CACHED TILE, THE KEY BYTES ARE FOLLOWED BY THE DATA */
+typedef struct entry
+{
+	struct entry *next;	 // next entry in the same bucket
+	struct entry *newer; // neighbours in the order of use
+	struct entry *older;
+	uint64_t hash;
+	int key_len;
+	int data_len;
+	unsigned char bytes[];
+} entry;
+
+/* STRUCT HOLDING THE WHOLE CACHE, USED ONLY BY THE BOSS THREAD */
+static struct
+{
+	size_t budget; // bytes the entries may take
+	size_t used;   // bytes the entries take now
+	entry **buckets;
+	int nbr_buckets;
+	int count;
+	entry *newest;
+	entry *oldest;
+} cache = {.budget = 0, .used = 0, .buckets = NULL, .count = 0,
+		   .newest = NULL, .oldest = NULL};
+
+/* START AN EMPTY CACHE, BUDGET 0 DISABLES IT */
+void cache_init(size_t budget)
+{
+	cache.budget = budget;
+	cache.used = 0;
+	cache.count = 0;
+	cache.newest = cache.oldest = NULL;
+	cache.nbr_buckets = CACHE_BUCKETS;
+	cache.buckets = my_alloc(cache.nbr_buckets * sizeof(entry *));
+	memset(cache.buckets, 0, cache.nbr_buckets * sizeof(entry *));
+	if (budget) // the disk store is the second level of the cache
+	{
+		store_init();
+	}
+}
+
+/* FREE ALL ENTRIES */
+void cache_cleanup(void)
+{
+	while (cache.oldest)
+	{
+		entry *e = cache.oldest;
+		cache.oldest = e->newer;
+		free(e);
+	}
+	free(cache.buckets);
+	store_cleanup();
+	cache.buckets = NULL;
+	cache.newest = NULL;
+	cache.used = 0;
+	cache.count = 0;
+}
+
+/* RETURN THE BYTES TAKEN BY THE CACHED ENTRIES */
+size_t cache_used(void)
+{
+	return cache.used;
+}
+
+/* FNV-1A HASH OF THE KEY */
+static uint64_t hash_key(const void *key, int key_len)
+{
+	const unsigned char *k = key;
+	uint64_t h = 14695981039346656037ULL;
+	for (int i = 0; i < key_len; i++)
+	{
+		h = (h ^ k[i]) * 1099511628211ULL;
+	}
+	return h;
+}
+
+/* RETURN THE LINK POINTING TO THE ENTRY WITH THE KEY OR TO THE BUCKET END */
+static entry **find(uint64_t hash, const void *key, int key_len)
+{
+	entry **link = &cache.buckets[hash & (cache.nbr_buckets - 1)];
+	while (*link && ((*link)->hash != hash || (*link)->key_len != key_len ||
+					 memcmp((*link)->bytes, key, key_len)))
+	{
+		link = &(*link)->next;
+	}
+	return link;
+}
+
+/* TAKE THE ENTRY OUT OF THE ORDER OF USE */
+static void unlink_entry(entry *e)
+{
+	*(e->newer ? &e->newer->older : &cache.newest) = e->older;
+	*(e->older ? &e->older->newer : &cache.oldest) = e->newer;
+}
+
+/* PUT THE ENTRY TO THE FRONT OF THE ORDER OF USE */
+static void push_newest(entry *e)
+{
+	e->newer = NULL;
+	e->older = cache.newest;
+	*(cache.newest ? &cache.newest->newer : &cache.oldest) = e;
+	cache.newest = e;
+}
+
+/* REMOVE THE ENTRY FROM THE CACHE */
+static void evict(entry *e)
+{
+	entry **link = find(e->hash, e->bytes, e->key_len);
+	*link = e->next;
+	unlink_entry(e);
+	cache.used -= sizeof(entry) + e->key_len + e->data_len;
+	cache.count--;
+	free(e);
+}
+
+/* DOUBLE THE HASH TABLE AND MOVE THE ENTRIES TO THEIR NEW BUCKETS */
+static void grow(void)
+{
+	entry **old = cache.buckets;
+	const int nbr_old = cache.nbr_buckets;
+	cache.nbr_buckets *= 2;
+	cache.buckets = my_alloc(cache.nbr_buckets * sizeof(entry *));
+	memset(cache.buckets, 0, cache.nbr_buckets * sizeof(entry *));
+	for (int i = 0; i < nbr_old; i++)
+	{
+		while (old[i])
+		{
+			entry *e = old[i];
+			old[i] = e->next;
+			entry **bucket = &cache.buckets[e->hash & (cache.nbr_buckets - 1)];
+			e->next = *bucket;
+			*bucket = e;
+		}
+	}
+	free(old);
+}
+
+/*
+ * Set the budget of the cache, the first call starts it. The entries stay
+ * for the whole process, the buffers of the grids are made again for every
+ * resolution or cell width, the cache is not. A smaller budget evicts the
+ * least recently used entries.
+ */
+void cache_budget(size_t budget)
+{
+	if (!cache.buckets)
+	{
+		cache_init(budget);
+		return;
+	}
+	if (budget && !cache.budget) // switched on, the store may be opened yet
+	{
+		store_init();
+	}
+	cache.budget = budget;
+	while (cache.used > cache.budget)
+	{
+		evict(cache.oldest);
+	}
+}
+
+/* KEEP THE DATA IN MEMORY, THE LEAST RECENTLY USED ONES MAKE ROOM */
+static void remember(const void *key, int key_len, const void *data,
+					 int data_len)
+{
+	const size_t size = sizeof(entry) + key_len + data_len;
+	if (!cache.buckets || size > cache.budget)
+	{
+		return;
+	}
+	const uint64_t hash = hash_key(key, key_len);
+	entry *old = *find(hash, key, key_len);
+	if (old)
+	{
+		evict(old);
+	}
+	while (cache.used + size > cache.budget)
+	{
+		evict(cache.oldest);
+	}
+	entry *e = my_alloc(size);
+	e->hash = hash;
+	e->key_len = key_len;
+	e->data_len = data_len;
+	memcpy(e->bytes, key, key_len);
+	memcpy(e->bytes + key_len, data, data_len);
+	entry **bucket = &cache.buckets[hash & (cache.nbr_buckets - 1)];
+	e->next = *bucket;
+	*bucket = e;
+	push_newest(e);
+	cache.used += size;
+	if (++cache.count > cache.nbr_buckets)
+	{
+		grow();
+	}
+}
+
+/* COPY THE DATA STORED UNDER THE KEY, THE DISK STORE IS ASKED ON A MISS */
+bool cache_get(const void *key, int key_len, void *data, int data_len)
+{
+	if (!cache.buckets || !cache.budget)
+	{
+		return false;
+	}
+	entry *e = *find(hash_key(key, key_len), key, key_len);
+	if (e && e->data_len == data_len)
+	{
+		memcpy(data, e->bytes + key_len, data_len);
+		unlink_entry(e);
+		push_newest(e);
+		return true;
+	}
+	if (store_get(key, key_len, data, data_len))
+	{
+		remember(key, key_len, data, data_len);
+		return true;
+	}
+	return false;
+}
+
+/* STORE THE DATA UNDER THE KEY IN MEMORY AND IN THE DISK STORE */
+void cache_put(const void *key, int key_len, const void *data, int data_len)
+{
+	if (cache.buckets && cache.budget)
+	{
+		remember(key, key_len, data, data_len);
+		store_put(key, key_len, data, data_len);
+	}
+}
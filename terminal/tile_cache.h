@@ -0,0 +1,18 @@
+///////////////////////////////////////////////////////////////////////////////
+//  LEAST RECENTLY USED CACHE OF THE COMPUTED TILES
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __TILE_CACHE_H__
+#define __TILE_CACHE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+void cache_init(size_t budget);
+void cache_budget(size_t budget);
+void cache_cleanup(void);
+bool cache_get(const void *key, int key_len, void *data, int data_len);
+void cache_put(const void *key, int key_len, const void *data, int data_len);
+size_t cache_used(void);
+
+#endif
@@ -0,0 +1,270 @@
+///////////////////////////////////////////////////////////////////////////////
+//  PERSISTENT MEMORY MAPPED STORE OF THE COMPUTED TILES
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The file starts with a header page and a hash index of fixed size, the
+ * records follow in a log written as a ring. A record is appended first and
+ * only then pointed to by the index, every record carries a checksum, so a
+ * crash in the middle of a write leaves a record which is never read. The
+ * oldest records get overwritten once the ring is full, their index slots
+ * then point to bytes of other records and fail the check as well. Only the
+ * header is read at startup, the rest is paged in on demand by the mapping.
+ */
+
+#include "tile_store.h"
+#include "my_functions.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define STORE_MAGIC 0x54435246u // "FRCT"
+#define STORE_VERSION 1
+#define STORE_MB 256		 // bytes of the ring of the records
+#define STORE_HEADER 4096	 // the header gets a page of its own
+#define STORE_SLOT_BYTES 4096 // expected bytes of a record per index slot
+#define STORE_PROBES 8		 // slots tried for one hash
+#define STORE_ALIGN 64		 // records start on cache lines
+
+/* HEADER AT THE START OF THE FILE */
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t nbr_slots; // power of two
+	uint64_t ring;		// bytes of the ring of the records
+	uint64_t head;		// ring offset the next record is written to
+} store_header;
+
+/* INDEX SLOT, OFFSET 0 IS EMPTY, OTHERWISE THE RING OFFSET + 1 */
+typedef struct
+{
+	uint64_t hash;
+	uint64_t offset;
+} store_slot;
+
+/* RECORD HEADER FOLLOWED BY THE KEY AND THE DATA */
+typedef struct
+{
+	uint32_t magic;
+	uint32_t key_len;
+	uint32_t data_len;
+	uint32_t reserved;
+	uint64_t hash;
+	uint64_t checksum; // of the fields above but magic, the key and the data
+} store_record;
+
+/* STRUCT HOLDING THE MAPPED FILE, USED ONLY BY THE BOSS THREAD */
+static struct
+{
+	int fd;
+	unsigned char *map; // NULL if the store is off
+	size_t size;
+	store_header *header;
+	store_slot *slots;
+	unsigned char *ring;
+} store = {.fd = -1, .map = NULL, .size = 0};
+
+/* FNV-1A HASH CONTINUED FROM THE SEED */
+static uint64_t fnv(uint64_t seed, const void *bytes, size_t len)
+{
+	const unsigned char *b = bytes;
+	for (size_t i = 0; i < len; i++)
+	{
+		seed = (seed ^ b[i]) * 1099511628211ULL;
+	}
+	return seed;
+}
+
+/* CHECKSUM OF THE RECORD, THE MAGIC AND THE CHECKSUM ITSELF EXCLUDED */
+static uint64_t checksum(const store_record *r, const void *key,
+						 const void *data)
+{
+	uint64_t sum = fnv(14695981039346656037ULL, &r->key_len,
+					   offsetof(store_record, checksum) -
+						   offsetof(store_record, key_len));
+	sum = fnv(sum, key, r->key_len);
+	return fnv(sum, data, r->data_len);
+}
+
+/* START A NEW EMPTY FILE OF THE SIZE, RETURN FALSE ON FAILURE */
+static bool format(uint64_t nbr_slots)
+{
+	// truncating to zero first drops the old pages, the file stays sparse
+	if (ftruncate(store.fd, 0) || ftruncate(store.fd, store.size))
+	{
+		return false;
+	}
+	store.map = mmap(NULL, store.size, PROT_READ | PROT_WRITE, MAP_SHARED,
+					 store.fd, 0);
+	if (store.map == MAP_FAILED)
+	{
+		store.map = NULL;
+		return false;
+	}
+	store.header = (store_header *)store.map;
+	store.header->nbr_slots = nbr_slots;
+	store.header->ring = (uint64_t)STORE_MB << 20;
+	store.header->head = 0;
+	store.header->version = STORE_VERSION;
+	store.header->magic = STORE_MAGIC; // the header is valid from now on
+	return true;
+}
+
+/* MAP THE STORE NAMED BY FRACTAL_STORE, THE STORE IS OFF WITHOUT IT */
+void store_init(void)
+{
+	const char *path = getenv("FRACTAL_STORE");
+	if (!path || !*path || store.map) // mapped already
+	{
+		return;
+	}
+	const uint64_t ring = (uint64_t)STORE_MB << 20;
+	const uint64_t nbr_slots = ring / STORE_SLOT_BYTES;
+	store.size = STORE_HEADER + nbr_slots * sizeof(store_slot) + ring;
+	store.fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (store.fd < 0 || flock(store.fd, LOCK_EX | LOCK_NB))
+	{
+		WARN("FRACTAL_STORE can not be opened or another process uses it\n");
+		store_cleanup();
+		return;
+	}
+	struct stat st;
+	store_header header = {.magic = 0};
+	const bool valid = !fstat(store.fd, &st) &&
+					   (size_t)st.st_size == store.size &&
+					   pread(store.fd, &header, sizeof(header), 0) ==
+						   sizeof(header) &&
+					   header.magic == STORE_MAGIC &&
+					   header.version == STORE_VERSION &&
+					   header.nbr_slots == nbr_slots && header.ring == ring &&
+					   header.head < ring;
+	if (valid)
+	{
+		store.map = mmap(NULL, store.size, PROT_READ | PROT_WRITE, MAP_SHARED,
+						 store.fd, 0);
+		store.map = store.map == MAP_FAILED ? NULL : store.map;
+		store.header = (store_header *)store.map;
+	}
+	if (!store.map && !format(nbr_slots))
+	{
+		WARN("FRACTAL_STORE can not be mapped, the tile store is off\n");
+		store_cleanup();
+		return;
+	}
+	store.slots = (store_slot *)(store.map + STORE_HEADER);
+	store.ring = store.map + STORE_HEADER + nbr_slots * sizeof(store_slot);
+	INFOF("Tile store %s %s, %d MB\n", path, valid ? "mapped" : "created",
+		  STORE_MB);
+}
+
+/* UNMAP AND CLOSE THE STORE, THE KERNEL WRITES THE DIRTY PAGES BACK */
+void store_cleanup(void)
+{
+	if (store.map)
+	{
+		munmap(store.map, store.size);
+	}
+	if (store.fd >= 0)
+	{
+		close(store.fd); // releases the lock as well
+	}
+	store.map = NULL;
+	store.fd = -1;
+}
+
+/* RETURN THE VALID RECORD THE SLOT POINTS TO, NULL IF IT WAS OVERWRITTEN */
+static const store_record *slot_record(const store_slot *slot)
+{
+	const uint64_t ring = store.header->ring;
+	if (!slot->offset || slot->offset - 1 + sizeof(store_record) > ring)
+	{
+		return NULL;
+	}
+	const store_record *r =
+		(const store_record *)(store.ring + slot->offset - 1);
+	if (r->magic != STORE_MAGIC || r->hash != slot->hash ||
+		slot->offset - 1 + sizeof(*r) + r->key_len + r->data_len > ring)
+	{
+		return NULL;
+	}
+	const unsigned char *key = (const unsigned char *)(r + 1);
+	return checksum(r, key, key + r->key_len) == r->checksum ? r : NULL;
+}
+
+/* COPY THE DATA STORED UNDER THE KEY, FALSE IF IT IS NOT STORED */
+bool store_get(const void *key, int key_len, void *data, int data_len)
+{
+	if (!store.map)
+	{
+		return false;
+	}
+	const uint64_t hash = fnv(14695981039346656037ULL, key, key_len);
+	const uint64_t mask = store.header->nbr_slots - 1;
+	for (int i = 0; i < STORE_PROBES; i++)
+	{
+		const store_slot *slot = &store.slots[(hash + i) & mask];
+		const store_record *r = slot->hash == hash ? slot_record(slot) : NULL;
+		if (r && (int)r->key_len == key_len && (int)r->data_len == data_len &&
+			!memcmp(r + 1, key, key_len))
+		{
+			memcpy(data, (const unsigned char *)(r + 1) + key_len, data_len);
+			return true;
+		}
+	}
+	return false;
+}
+
+/* APPEND THE RECORD TO THE RING AND POINT THE INDEX TO IT */
+void store_put(const void *key, int key_len, const void *data, int data_len)
+{
+	const uint64_t size = (sizeof(store_record) + key_len + data_len +
+						   STORE_ALIGN - 1) & ~(uint64_t)(STORE_ALIGN - 1);
+	if (!store.map || size > store.header->ring)
+	{
+		return;
+	}
+	uint64_t head = store.header->head;
+	if (head + size > store.header->ring) // wrap, the oldest records go
+	{
+		head = 0;
+	}
+	store_record *r = (store_record *)(store.ring + head);
+	r->magic = 0; // invalid until the whole record is written
+	memcpy(r + 1, key, key_len);
+	memcpy((unsigned char *)(r + 1) + key_len, data, data_len);
+	r->key_len = key_len;
+	r->data_len = data_len;
+	r->reserved = 0;
+	r->hash = fnv(14695981039346656037ULL, key, key_len);
+	r->checksum = checksum(r, key, data);
+	__atomic_store_n(&r->magic, STORE_MAGIC, __ATOMIC_RELEASE);
+	// the slot of the same key, an empty or overwritten one, or the first
+	const uint64_t mask = store.header->nbr_slots - 1;
+	store_slot *victim = NULL;
+	for (int i = 0; i < STORE_PROBES; i++)
+	{
+		store_slot *slot = &store.slots[(r->hash + i) & mask];
+		const store_record *old = slot_record(slot);
+		if (old && (int)old->key_len == key_len &&
+			!memcmp(old + 1, key, key_len))
+		{
+			victim = slot;
+			break;
+		}
+		if (!old && !victim)
+		{
+			victim = slot;
+		}
+	}
+	victim = victim ? victim : &store.slots[r->hash & mask];
+	victim->hash = r->hash;
+	__atomic_store_n(&victim->offset, head + 1, __ATOMIC_RELEASE);
+	store.header->head = head + size;
+}
@@ -0,0 +1,15 @@
+///////////////////////////////////////////////////////////////////////////////
+//  PERSISTENT MEMORY MAPPED STORE OF THE COMPUTED TILES
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __TILE_STORE_H__
+#define __TILE_STORE_H__
+
+#include <stdbool.h>
+
+void store_init(void);
+void store_cleanup(void);
+bool store_get(const void *key, int key_len, void *data, int data_len);
+void store_put(const void *key, int key_len, const void *data, int data_len);
+
+#endif
@@ -0,0 +1,195 @@
+///////////////////////////////////////////////////////////////////////////////
+//  VIDEO EXPORT OF THE FRAMES TO Y4M OR RAW RGB
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The frames are copied to a bounded queue and the encoder thread converts
+ * them and writes them out, so the disk is never touched by the threads
+ * which render or show the frames. The written buffers go back through a
+ * second queue, the caller waits for one when all of them are queued, no
+ * frame is dropped. A file ending with .y4m gets the
+ * YUV 4:2:0 frames of BT.601 studio range, the header says so with
+ * XCOLORRANGE=LIMITED, and the chroma of 2 x 2 pixels sits in their centre,
+ * plain C420. Any other file gets the raw rgb24 frames as they are, e.g.
+ * for ffmpeg -f rawvideo -pix_fmt rgb24.
+ */
+
+#include "video.h"
+#include "my_functions.h"
+#include "work_queue.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define VIDEO_QUEUE 16 // frames waiting for the encoder
+
+/* STRUCT HOLDING THE OPEN VIDEO */
+static struct
+{
+	FILE *file; // NULL if no video is open
+	bool y4m;
+	int w;
+	int h;
+	unsigned char *yuv; // planes of one converted frame
+	size_t yuv_size;
+	pthread_t encoder;
+	work_queue frames; // copied frames waiting for the encoder
+	work_queue spare;  // buffers free for the next frames
+	bool failed;	   // encoder thread only until it is joined
+	int written;
+} video = {.file = NULL};
+
+/* CONVERT THE RGB FRAME TO THE Y, U AND V PLANES, CHROMA OF 2 X 2 PIXELS */
+static void rgb_to_yuv(const unsigned char *rgb, unsigned char *yuv)
+{
+	const int w = video.w;
+	const int h = video.h;
+	const int cw = (w + 1) / 2;
+	const int ch = (h + 1) / 2;
+	unsigned char *u = yuv + w * h;
+	unsigned char *v = u + cw * ch;
+	for (int i = 0; i < w * h; i++, rgb += 3)
+	{
+		yuv[i] = 16 + ((66 * rgb[0] + 129 * rgb[1] + 25 * rgb[2] + 128) >> 8);
+	}
+	rgb -= 3 * w * h;
+	for (int cy = 0; cy < ch; cy++)
+	{
+		for (int cx = 0; cx < cw; cx++)
+		{
+			int r = 0, g = 0, b = 0, count = 0;
+			for (int y = 2 * cy; y < MIN(2 * cy + 2, h); y++)
+			{
+				for (int x = 2 * cx; x < MIN(2 * cx + 2, w); x++)
+				{
+					const unsigned char *p = rgb + 3 * (y * w + x);
+					r += p[0];
+					g += p[1];
+					b += p[2];
+					count++;
+				}
+			}
+			r /= count;
+			g /= count;
+			b /= count;
+			u[cy * cw + cx] = 128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8);
+			v[cy * cw + cx] = 128 + ((112 * r - 94 * g - 18 * b + 128) >> 8);
+		}
+	}
+}
+
+/* WRITE ONE FRAME, FALSE ON AN ERROR */
+static bool write_frame(const unsigned char *rgb)
+{
+	if (!video.y4m)
+	{
+		return fwrite(rgb, 3 * video.w * video.h, 1, video.file) == 1;
+	}
+	rgb_to_yuv(rgb, video.yuv);
+	return fputs("FRAME\n", video.file) >= 0 &&
+		   fwrite(video.yuv, video.yuv_size, 1, video.file) == 1;
+}
+
+/* TAKE THE FRAMES FROM THE QUEUE AND WRITE THEM UNTIL THE VIDEO IS CLOSED */
+static void *encoder_thread(void *arg)
+{
+	(void)arg;
+	void *rgb;
+	while ((rgb = work_queue_pop(&video.frames)))
+	{
+		if (!video.failed) // the rest is dropped after an error
+		{
+			video.failed = !write_frame(rgb);
+			video.written += !video.failed;
+		}
+		work_queue_push(&video.spare, &rgb, 1, true);
+	}
+	return NULL;
+}
+
+/* START THE VIDEO OF W X H FRAMES, FALSE IF THE FILE CAN NOT BE OPENED */
+bool video_open(const char *path, int w, int h, int fps)
+{
+	if (video.file || !path || !*path)
+	{
+		return false;
+	}
+	video.file = fopen(path, "wb");
+	if (!video.file)
+	{
+		WARN("The video file can not be opened\n");
+		return false;
+	}
+	const size_t len = strlen(path);
+	video.y4m = len > 4 && !strcmp(path + len - 4, ".y4m");
+	video.w = w;
+	video.h = h;
+	video.yuv_size = w * h + 2 * ((w + 1) / 2) * ((h + 1) / 2);
+	video.yuv = video.y4m ? my_alloc(video.yuv_size) : NULL;
+	work_queue_init(&video.frames, VIDEO_QUEUE);
+	work_queue_init(&video.spare, VIDEO_QUEUE);
+	for (int i = 0; i < VIDEO_QUEUE; i++)
+	{
+		void *buffer = my_alloc(3 * w * h);
+		work_queue_push(&video.spare, &buffer, 1, true);
+	}
+	video.failed = false;
+	video.written = 0;
+	if (video.y4m)
+	{
+		fprintf(video.file,
+				"YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420 XCOLORRANGE=LIMITED\n", w,
+				h, fps);
+	}
+	if (pthread_create(&video.encoder, NULL, encoder_thread, NULL))
+	{
+		ERROR("Could not start the video encoder thread.\n");
+		exit(100);
+	}
+	return true;
+}
+
+/* RETURN TRUE IF A VIDEO IS OPEN */
+bool video_recording(void)
+{
+	return video.file != NULL;
+}
+
+/* QUEUE A COPY OF THE RGB FRAME, WAITS ONLY WHILE THE QUEUE IS FULL */
+void video_frame(const unsigned char *rgb)
+{
+	if (!video.file)
+	{
+		return;
+	}
+	void *slot = work_queue_pop(&video.spare); // waits while all are queued
+	memcpy(slot, rgb, 3 * video.w * video.h);
+	work_queue_push(&video.frames, &slot, 1, true);
+}
+
+/* WRITE THE QUEUED FRAMES, CLOSE THE FILE AND RETURN THE FRAMES WRITTEN */
+int video_close(void)
+{
+	if (!video.file)
+	{
+		return 0;
+	}
+	work_queue_close(&video.frames);
+	pthread_join(video.encoder, NULL);
+	if (fclose(video.file) || video.failed)
+	{
+		WARN("The video file could not be written completely\n");
+	}
+	video.file = NULL;
+	work_queue_close(&video.spare); // all buffers are back in it
+	void *buffer;
+	while ((buffer = work_queue_pop(&video.spare)))
+	{
+		free(buffer);
+	}
+	work_queue_cleanup(&video.frames);
+	work_queue_cleanup(&video.spare);
+	free(video.yuv);
+	video.yuv = NULL;
+	return video.written;
+}
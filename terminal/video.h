@@ -0,0 +1,15 @@
+///////////////////////////////////////////////////////////////////////////////
+//  VIDEO EXPORT OF THE FRAMES TO Y4M OR RAW RGB
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __VIDEO_H__
+#define __VIDEO_H__
+
+#include <stdbool.h>
+
+bool video_open(const char *path, int w, int h, int fps);
+bool video_recording(void);
+void video_frame(const unsigned char *rgb);
+int video_close(void);
+
+#endif
@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////////////////////////////////
+//  BOUNDED QUEUE OF POINTERS HANDED TO BACKGROUND THREADS
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Used by the image writers and the video encoder. The producer either
+ * waits for room or gets false back and drops its items. Once the queue is
+ * closed, the consumers still take what is left and then get NULL.
+ */
+
+#include "work_queue.h"
+#include "my_functions.h"
+#include <stdlib.h>
+
+/* PREPARE THE EMPTY QUEUE OF UP TO CAPACITY ITEMS */
+void work_queue_init(work_queue *q, int capacity)
+{
+	my_assert(capacity > 0 && capacity <= WORK_QUEUE_MAX, __func__, __LINE__,
+			  __FILE__);
+	q->capacity = capacity;
+	q->head = q->tail = 0;
+	q->closing = false;
+	if (pthread_mutex_init(&q->mtx, NULL) || pthread_cond_init(&q->cond, NULL))
+	{
+		ERROR("Could not initialize the work queue.\n");
+		exit(100);
+	}
+}
+
+/* FREE THE MUTEX AND CONDVAR, NO THREAD MAY USE THE QUEUE ANY MORE */
+void work_queue_cleanup(work_queue *q)
+{
+	pthread_mutex_destroy(&q->mtx);
+	pthread_cond_destroy(&q->cond);
+}
+
+/*
+ * Put all count items or none of them. With wait it blocks until there is
+ * room, without it a full queue returns false.
+ */
+bool work_queue_push(work_queue *q, void *const *items, int count, bool wait)
+{
+	my_assert(count <= q->capacity, __func__, __LINE__, __FILE__);
+	pthread_mutex_lock(&q->mtx);
+	while (wait && q->tail - q->head + count > q->capacity)
+	{
+		pthread_cond_wait(&q->cond, &q->mtx);
+	}
+	const bool ret = q->tail - q->head + count <= q->capacity;
+	for (int i = 0; ret && i < count; i++)
+	{
+		q->items[q->tail++ % q->capacity] = items[i];
+	}
+	pthread_cond_broadcast(&q->cond);
+	pthread_mutex_unlock(&q->mtx);
+	return ret;
+}
+
+/* TAKE THE OLDEST ITEM, WAIT FOR ONE, NULL IF CLOSED AND EMPTY */
+void *work_queue_pop(work_queue *q)
+{
+	void *ret = NULL;
+	pthread_mutex_lock(&q->mtx);
+	while (!q->closing && q->head == q->tail)
+	{
+		pthread_cond_wait(&q->cond, &q->mtx);
+	}
+	if (q->head != q->tail)
+	{
+		ret = q->items[q->head++ % q->capacity];
+		pthread_cond_broadcast(&q->cond); // a place in the queue is free
+	}
+	pthread_mutex_unlock(&q->mtx);
+	return ret;
+}
+
+/* WAKE THE CONSUMERS, THEY EMPTY THE QUEUE AND THEN GET NULL */
+void work_queue_close(work_queue *q)
+{
+	pthread_mutex_lock(&q->mtx);
+	q->closing = true;
+	pthread_cond_broadcast(&q->cond);
+	pthread_mutex_unlock(&q->mtx);
+}
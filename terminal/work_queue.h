@@ -0,0 +1,31 @@
+///////////////////////////////////////////////////////////////////////////////
+//  BOUNDED QUEUE OF POINTERS HANDED TO BACKGROUND THREADS
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __WORK_QUEUE_H__
+#define __WORK_QUEUE_H__
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#define WORK_QUEUE_MAX 16 // largest capacity of one queue
+
+/* THE ITEMS ARE OWNED BY THE USER, THE QUEUE ONLY PASSES THEM ON */
+typedef struct
+{
+	void *items[WORK_QUEUE_MAX];
+	int capacity;
+	int head; // items taken
+	int tail; // items put
+	bool closing;
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+} work_queue;
+
+void work_queue_init(work_queue *q, int capacity);
+void work_queue_cleanup(work_queue *q);
+bool work_queue_push(work_queue *q, void *const *items, int count, bool wait);
+void *work_queue_pop(work_queue *q);
+void work_queue_close(work_queue *q);
+
+#endif
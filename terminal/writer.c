@@ -0,0 +1,213 @@
+///////////////////////////////////////////////////////////////////////////////
+//  IMAGES SAVED IN THE BACKGROUND BY A POOL OF WRITERS
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The boss only hands over a copy of the shown pixels. The writer threads
+ * encode it, one job per format, so the formats of one render are written
+ * side by side. FRACTAL_SAVE lists the formats, e.g. "png,bmp", all three
+ * are written without it. Every render gets a name of its own made of the
+ * start time of the program and its number, fractal-20260101-120000-003.png,
+ * so no save overwrites another. A full queue drops the render with a
+ * warning instead of making the boss wait.
+ */
+
+#include "writer.h"
+#include "my_functions.h"
+#include "work_queue.h"
+#include "xwin_sdl.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define WRITER_THREADS 2 // images encoded at once
+#define WRITER_QUEUE 16	 // formats waiting for a writer
+#define WRITER_NAME 64	 // longest file name
+
+/* FORMATS THE IMAGES CAN BE SAVED IN */
+enum
+{
+	FORMAT_PNG,
+	FORMAT_JPG,
+	FORMAT_BMP,
+	FORMAT_NBR
+};
+
+static const char *format_names[FORMAT_NBR] = {"png", "jpg", "bmp"};
+
+static void (*const format_savers[FORMAT_NBR])(const char *, int, int,
+											   uint32_t *) = {
+	save_image_png, save_image_jpg, save_image_bmp};
+
+/* ONE RENDER, SHARED BY THE JOBS OF ITS FORMATS */
+typedef struct
+{
+	int w;
+	int h;
+	uint32_t *pixels;
+	int number;
+	int refs; // jobs not written yet, decreased atomically
+} snapshot;
+
+/* ONE FORMAT OF A RENDER WAITING FOR A WRITER */
+typedef struct
+{
+	snapshot *shot;
+	int format;
+} write_job;
+
+/* STRUCT HOLDING THE WRITERS */
+static struct
+{
+	bool formats[FORMAT_NBR];
+	int nbr_formats;
+	char stamp[32]; // start time of the program, part of the names
+	int renders;	// renders handed over so far, boss thread only
+	bool running;
+	pthread_t threads[WRITER_THREADS];
+	work_queue jobs;
+} writer = {.running = false};
+
+/* READ THE FORMATS OF FRACTAL_SAVE, ALL OF THEM WITHOUT IT */
+static void read_formats(void)
+{
+	const char *list = getenv("FRACTAL_SAVE");
+	for (int f = 0; f < FORMAT_NBR; f++)
+	{
+		writer.formats[f] = list == NULL;
+	}
+	if (list)
+	{
+		char words[WRITER_NAME];
+		snprintf(words, sizeof(words), "%s", list);
+		for (char *w = strtok(words, ", "); w; w = strtok(NULL, ", "))
+		{
+			int f = 0;
+			while (f < FORMAT_NBR && strcmp(w, format_names[f]))
+			{
+				f++;
+			}
+			if (f < FORMAT_NBR)
+			{
+				writer.formats[f] = true;
+			}
+			else
+			{
+				WARN("FRACTAL_SAVE names an unknown format ");
+				fprintf(stderr, "%s\n", w);
+			}
+		}
+	}
+	writer.nbr_formats = 0;
+	for (int f = 0; f < FORMAT_NBR; f++)
+	{
+		writer.nbr_formats += writer.formats[f];
+	}
+}
+
+/* TAKE THE JOBS FROM THE QUEUE AND WRITE THEM UNTIL THE WRITERS ARE CLOSED */
+static void *writer_thread(void *arg)
+{
+	(void)arg;
+	write_job *job;
+	while ((job = work_queue_pop(&writer.jobs)))
+	{
+		snapshot *shot = job->shot;
+		char name[WRITER_NAME];
+		snprintf(name, sizeof(name), "fractal-%s-%03d.%s", writer.stamp,
+				 shot->number, format_names[job->format]);
+		format_savers[job->format](name, shot->w, shot->h, shot->pixels);
+		free(job);
+		const int left = __atomic_sub_fetch(&shot->refs, 1, __ATOMIC_ACQ_REL);
+		if (left == 0) // the last format of the render
+		{
+			free(shot->pixels);
+			free(shot);
+		}
+	}
+	return NULL;
+}
+
+/* START THE WRITERS WITH THE FORMATS OF FRACTAL_SAVE */
+void writer_init(void)
+{
+	if (writer.running)
+	{
+		return;
+	}
+	read_formats();
+	const time_t now = time(NULL);
+	strftime(writer.stamp, sizeof(writer.stamp), "%Y%m%d-%H%M%S",
+			 localtime(&now));
+	writer.renders = 0;
+	work_queue_init(&writer.jobs, WRITER_QUEUE);
+	for (int i = 0; i < WRITER_THREADS; i++)
+	{
+		if (pthread_create(&writer.threads[i], NULL, writer_thread, NULL))
+		{
+			ERROR("Could not start the image writer threads.\n");
+			exit(100);
+		}
+	}
+	writer.running = true;
+}
+
+/*
+ * Queue the w x h pixels of the texture format in every selected format,
+ * the writers own and free them. False if nothing is going to be written.
+ */
+bool writer_save(int w, int h, uint32_t *pixels)
+{
+	if (!writer.running || writer.nbr_formats == 0)
+	{
+		free(pixels);
+		return false;
+	}
+	snapshot *shot = my_alloc(sizeof(snapshot));
+	*shot = (snapshot){.w = w,
+					   .h = h,
+					   .pixels = pixels,
+					   .number = writer.renders + 1,
+					   .refs = writer.nbr_formats};
+	write_job *jobs[FORMAT_NBR];
+	int count = 0;
+	for (int f = 0; f < FORMAT_NBR; f++)
+	{
+		if (writer.formats[f])
+		{
+			jobs[count] = my_alloc(sizeof(write_job));
+			*jobs[count++] = (write_job){.shot = shot, .format = f};
+		}
+	}
+	if (!work_queue_push(&writer.jobs, (void *const *)jobs, count, false))
+	{
+		WARN("The image writers are busy, the picture was not saved\n");
+		for (int i = 0; i < count; i++)
+		{
+			free(jobs[i]);
+		}
+		free(shot);
+		free(pixels);
+		return false;
+	}
+	writer.renders++;
+	return true;
+}
+
+/* WRITE THE QUEUED IMAGES AND STOP THE WRITERS */
+void writer_cleanup(void)
+{
+	if (!writer.running)
+	{
+		return;
+	}
+	work_queue_close(&writer.jobs);
+	for (int i = 0; i < WRITER_THREADS; i++)
+	{
+		pthread_join(writer.threads[i], NULL);
+	}
+	work_queue_cleanup(&writer.jobs);
+	writer.running = false;
+}
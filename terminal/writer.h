@@ -0,0 +1,15 @@
+///////////////////////////////////////////////////////////////////////////////
+//  IMAGES SAVED IN THE BACKGROUND BY A POOL OF WRITERS
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __WRITER_H__
+#define __WRITER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+void writer_init(void);
+bool writer_save(int w, int h, uint32_t *pixels);
+void writer_cleanup(void);
+
+#endif
@@ -2,6 +2,13 @@
 //  FUNCTIONS FOR VISUALIZING THE FRACTAL IN GUI
 ///////////////////////////////////////////////////////////////////////////////
 
+/*
+ * The window is drawn by a renderer through a streaming texture of the
+ * first 32 bit format the renderer takes natively, so the colors are written
+ * straight into the locked texture and uploaded without any conversion.
+ * Presenting waits for the vertical sync.
+ */
+
 #include <assert.h>
 #include <SDL.h>
 #include <SDL_image.h>
@@ -9,6 +16,9 @@
 #include "my_functions.h"
 
 static SDL_Window *win = NULL;
+static SDL_Renderer *renderer = NULL;
+static SDL_Texture *texture = NULL;
+static Uint32 format = SDL_PIXELFORMAT_ARGB8888; // of the texture, if no other 8888 one
 static unsigned char icon_32x32_bits[] = {
     0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x20, 0x00, 0x00, 0x23, 0x00, 0x01, 0x29, 0x00, 0x01, 0x2e, 0x00, 0x02, 0x31, 0x00, 0x02, 0x34, 0x00, 0x02, 0x35, 0x00, 0x02, 0x33, 0x00, 0x02, 0x31, 0x00, 0x01, 0x2d, 0x00, 0x01, 0x29, 0x00, 0x00, 0x23, 0x00, 0x00, 0x20, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21,
     0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x23, 0x00, 0x01, 0x2b, 0x00, 0x02, 0x3b, 0x00, 0x03, 0x41, 0x00, 0x03, 0x43, 0x00, 0x04, 0x46, 0x00, 0x04, 0x49, 0x00, 0x05, 0x4d, 0x00, 0x04, 0x46, 0x00, 0x03, 0x43, 0x00, 0x03, 0x3f, 0x00, 0x03, 0x40, 0x00, 0x03, 0x41, 0x00, 0x03, 0x42, 0x00, 0x03, 0x3c, 0x00, 0x01, 0x2d, 0x00, 0x00, 0x24, 0x00, 0x00, 0x20, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21, 0x00, 0x00, 0x21,
@@ -61,6 +71,27 @@ int xwin_init(int w, int h)
                                                    0xff0000, 0x0000);
    SDL_SetWindowIcon(win, surface);
    SDL_FreeSurface(surface);
+   renderer = SDL_CreateRenderer(win, -1, SDL_RENDERER_PRESENTVSYNC);
+   assert(renderer != NULL);
+   SDL_RendererInfo info;
+   if (SDL_GetRendererInfo(renderer, &info) == 0)
+   {
+      for (Uint32 i = 0; i < info.num_texture_formats; ++i)
+      {
+         const Uint32 f = info.texture_formats[i];
+         // 8 bits a channel, as the palette writes them
+         if (SDL_ISPIXELFORMAT_PACKED(f) &&
+             SDL_PIXELLAYOUT(f) == SDL_PACKEDLAYOUT_8888)
+         {
+            format = f;
+            break;
+         }
+      }
+   }
+   texture = SDL_CreateTexture(renderer, format, SDL_TEXTUREACCESS_STREAMING,
+                               w, h);
+   assert(texture != NULL);
+   SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_NONE); // alpha is ignored
    return r;
 }
 
@@ -68,27 +99,58 @@ int xwin_init(int w, int h)
 void xwin_close()
 {
    assert(win != NULL);
+   SDL_DestroyTexture(texture);
+   SDL_DestroyRenderer(renderer);
+   texture = NULL;
+   renderer = NULL;
    SDL_DestroyWindow(win);
    SDL_Quit();
 }
 
-/* REDREAW PICTURE USING *IMG ON RGB VALUES, ONE PIXEL = THREE 8BIT VALUES */
-void xwin_redraw(int w, int h, unsigned char *img)
+/* RETURN THE BIT OFFSETS OF THE CHANNELS IN THE PIXELS OF THE TEXTURE */
+pixel_format xwin_format(void)
 {
-   assert(img && win);
-   SDL_Surface *scr = SDL_GetWindowSurface(win);
-   for (int y = 0; y < scr->h; ++y)
-   {
-      for (int x = 0; x < scr->w; ++x)
-      {
-         const int idx = (y * scr->w + x) * scr->format->BytesPerPixel;
-         Uint8 *px = (Uint8 *)scr->pixels + idx;
-         *(px + scr->format->Rshift / 8) = *(img++);
-         *(px + scr->format->Gshift / 8) = *(img++);
-         *(px + scr->format->Bshift / 8) = *(img++);
-      }
-   }
-   SDL_UpdateWindowSurface(win);
+   int bpp;
+   Uint32 r, g, b, a;
+   SDL_PixelFormatEnumToMasks(format, &bpp, &r, &g, &b, &a);
+   const int shift[3] = {__builtin_ctz(r), __builtin_ctz(g), __builtin_ctz(b)};
+   // the byte left by the colors, the alpha or the unused one of the 8888
+   return (pixel_format){.r = shift[0],
+                         .g = shift[1],
+                         .b = shift[2],
+                         .a = 48 - shift[0] - shift[1] - shift[2]};
+}
+
+/* LOCK THE RECTANGLE OF THE TEXTURE FOR WRITING, ROWS PITCH BYTES APART */
+uint32_t *xwin_lock(int x, int y, int w, int h, int *pitch)
+{
+   assert(texture);
+   const SDL_Rect rect = {.x = x, .y = y, .w = w, .h = h};
+   void *pixels;
+   my_assert(SDL_LockTexture(texture, &rect, &pixels, pitch) == 0, __func__,
+             __LINE__, __FILE__);
+   return pixels;
+}
+
+/* UNLOCK THE TEXTURE, ONLY THE LOCKED RECTANGLE IS UPLOADED */
+void xwin_unlock(void)
+{
+   SDL_UnlockTexture(texture);
+}
+
+/* SHOW THE TEXTURE ON THE NEXT VERTICAL SYNC */
+void xwin_present(void)
+{
+   SDL_RenderCopy(renderer, texture, NULL, NULL);
+   SDL_RenderPresent(renderer);
+}
+
+/* CONVERT THE RGB IMAGE, THREE 8BIT VALUES A PIXEL, TO THE TEXTURE FORMAT */
+void xwin_convert(int w, int h, const unsigned char *img, uint32_t *pixels,
+                  int pitch)
+{
+   SDL_ConvertPixels(w, h, SDL_PIXELFORMAT_RGB24, img, 3 * w, format, pixels,
+                     pitch);
 }
 
 /* CLEAR THE EVENT QUEUE, WE SHOULD CALL IT EVERYTIME AT PICTURE REFRESH */
@@ -99,32 +161,47 @@ void xwin_poll_events(void)
       ;
 }
 
-/* SAVE IMAGE TO BMP - LOW QUALITY */
-void save_image_jpg()
+/* WRAP THE PIXELS OF THE TEXTURE FORMAT INTO A SURFACE */
+static SDL_Surface *pixels_surface(int w, int h, uint32_t *pixels)
+{
+   SDL_Surface *scr = SDL_CreateRGBSurfaceWithFormatFrom(pixels, w, h, 32,
+                                                         4 * w, format);
+   my_assert(scr, __func__, __LINE__, __FILE__);
+   return scr;
+}
+
+/* PRINT THE NAME OF THE SAVED PICTURE IN ONE PIECE, ANY THREAD SAVES */
+static void report_save(const char *name, bool ok)
+{
+   char line[128];
+   snprintf(line, sizeof(line), "The picture %s %s\n", name,
+            ok ? "was saved" : "could not be saved");
+   ok ? INFO(line) : WARN(line);
+}
+
+/* SAVE IMAGE TO JPG - LOW QUALITY */
+void save_image_jpg(const char *name, int w, int h, uint32_t *pixels)
 {
-   my_assert(win, __func__, __LINE__, __FILE__);
-   SDL_Surface *scr = SDL_GetWindowSurface(win);
-   const char *name = "fractal.jpg";
-   IMG_SaveJPG(scr, name, 100);
-   INFO("The picture in jpg format was saved\n");
+   SDL_Surface *scr = pixels_surface(w, h, pixels);
+   const bool ok = IMG_SaveJPG(scr, name, 100) == 0;
+   SDL_FreeSurface(scr);
+   report_save(name, ok);
 }
 
 /* SAVE IMAGE TO PNG - MEDIUM QUALITY */
-void save_image_png()
+void save_image_png(const char *name, int w, int h, uint32_t *pixels)
 {
-   my_assert(win, __func__, __LINE__, __FILE__);
-   SDL_Surface *scr = SDL_GetWindowSurface(win);
-   const char *name = "fractal.png";
-   IMG_SavePNG(scr, name);
-   INFO("The picture in png format was saved\n");
+   SDL_Surface *scr = pixels_surface(w, h, pixels);
+   const bool ok = IMG_SavePNG(scr, name) == 0;
+   SDL_FreeSurface(scr);
+   report_save(name, ok);
 }
 
 /* SAVE IMAGE TO BMP - EXTRA QUALITY */
-void save_image_bmp()
+void save_image_bmp(const char *name, int w, int h, uint32_t *pixels)
 {
-   my_assert(win, __func__, __LINE__, __FILE__);
-   SDL_Surface *scr = SDL_GetWindowSurface(win);
-   const char *name = "fractal.bmp";
-   SDL_SaveBMP(scr, name);
-   INFO("The picture in bmp format was saved\n");
+   SDL_Surface *scr = pixels_surface(w, h, pixels);
+   const bool ok = SDL_SaveBMP(scr, name) == 0;
+   SDL_FreeSurface(scr);
+   report_save(name, ok);
 }
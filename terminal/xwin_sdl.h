@@ -5,12 +5,20 @@
 #ifndef __XWIN_SDL_H__
 #define __XWIN_SDL_H__
 
+#include <stdint.h>
+#include "palette.h"
+
 int xwin_init(int w, int h);
 void xwin_close();
-void xwin_redraw(int w, int h, unsigned char *img);
+pixel_format xwin_format(void);
+uint32_t *xwin_lock(int x, int y, int w, int h, int *pitch);
+void xwin_unlock(void);
+void xwin_present(void);
+void xwin_convert(int w, int h, const unsigned char *img, uint32_t *pixels,
+                  int pitch);
 void xwin_poll_events(void);
-void save_image_png();
-void save_image_bmp();
-void save_image_jpg();
+void save_image_png(const char *name, int w, int h, uint32_t *pixels);
+void save_image_bmp(const char *name, int w, int h, uint32_t *pixels);
+void save_image_jpg(const char *name, int w, int h, uint32_t *pixels);
 
 #endif